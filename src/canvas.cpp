@@ -94,14 +94,23 @@ Canvas::SetNetwork(std::shared_ptr<Network> net) {
 
 void
 Canvas::StartAnimation() { 
+    animating_ = true;
+    settled_frames_ = 0;
     animation_timer_.Start();
 }
 
 void
 Canvas::StopAnimation() { 
+    animating_ = false;
     animation_timer_.Stop();
 }
 
+void
+Canvas::WakeAnimation() {
+    settled_frames_ = 0;
+    if (animating_ && !animation_timer_.IsRunning()) animation_timer_.Start();
+}
+
 void
 Canvas::OnPaintEvent(wxPaintEvent &evt) {
     wxBufferedPaintDC dc(this);
@@ -145,6 +154,7 @@ Canvas::OnLeftUpEvent(wxMouseEvent &evt) {
     if (picked_) {
         net_->unpin_node(picked_->id());
         picked_ = nullptr;
+        WakeAnimation();
     }
     click_pos_cli_ = std::nullopt;
     click_pos_net_ = std::nullopt;
@@ -171,6 +181,7 @@ void Canvas::OnMouseMoving(wxMouseEvent &evt) {
             double dx_net = pos_net.x - ptr_pos_net_->x;
             double dy_net = pos_net.y - ptr_pos_net_->y;
             net_->translate_node(picked_->id(), dx_net, dy_net);
+            WakeAnimation();
         } else { //otherwise pan the camera
             int dx_cli = ptr_pos_cli_->x - click_pos_cli_->x;
             int dy_cli = ptr_pos_cli_->y - click_pos_cli_->y;
@@ -205,6 +216,9 @@ Canvas::OnTimerEvent(wxTimerEvent &evt) {
     if (evt.GetTimer().GetId() == ANIMATION_TIMER_ID) {
         if (net_) {
             for (size_t i=0; i != iterations_per_frame_; ++i) net_->simulate_step();
+            //stop burning cpu once the layout has settled, WakeAnimation restarts us
+            settled_frames_ = net_->converged(settle_tolerance_) ? settled_frames_ + 1 : 0;
+            if (settled_frames_ >= settle_frames_) animation_timer_.Stop();
         }
         Refresh();
         Update();
@@ -291,7 +305,7 @@ Canvas::OnGestureZoom(wxZoomGestureEvent &evt) {
 
 void
 Canvas::PaintImage(wxImage &img) {
-    bool was_animating_ = animation_timer_.IsRunning();
+    bool was_animating_ = animating_;
     bool was_tracking_ = auto_track_;
 
     StopAnimation();
@@ -301,7 +315,7 @@ Canvas::PaintImage(wxImage &img) {
     render(std::move(gc));
 
     auto_track_ = was_tracking_;
-    if (was_animating_) animation_timer_.Start();
+    if (was_animating_) StartAnimation();
 }
 
 void
@@ -402,12 +416,12 @@ Canvas::PaintSVG(wxSVGFileDC &dc) {
     float net_y_max = 1.0f;
 
     if (!net_->nodes().empty()) {
-        const Node &n = net_->begin()->second;
+        const Node &n = *net_->begin();
         net_x_min = net_x_max = n.pos.x;
         net_y_min = net_y_max = n.pos.y;
     }
 
-    for (auto &[_, n] : *net_) {
+    for (Node &n : *net_) {
         if (n.pos.x < net_x_min) net_x_min = n.pos.x;
         if (n.pos.x > net_x_max) net_x_max = n.pos.x;
         if (n.pos.y < net_y_min) net_y_min = n.pos.y;
@@ -426,7 +440,7 @@ Canvas::PaintSVG(wxSVGFileDC &dc) {
         net_y_max = m + 0.5f;
     }
 
-    for (auto &[_, n] : *net_) {
+    for (Node &n : *net_) {
         if (n.pos.x < net_x_min) net_x_min = n.pos.x;
         if (n.pos.x > net_x_max) net_x_max = n.pos.x;
         if (n.pos.y < net_y_min) net_y_min = n.pos.y;
@@ -471,7 +485,7 @@ Canvas::PaintSVG(wxSVGFileDC &dc) {
 
     //remember to put our coordinates back where we found them and hope
     //nobody noticed what we did...
-    for (auto &[_, n] : *net_) {
+    for (Node &n : *net_) {
         n.pos.x /= svg_scale_factor_;
         n.pos.y /= svg_scale_factor_;
         n.r     /= svg_scale_factor_;
@@ -492,17 +506,12 @@ Canvas::render(std::unique_ptr<wxGraphicsContext> &&gc) {
     if (!net_ || net_->nodes().empty()) return;
 
     if (auto_track_) {
-        Node &root = net_->node(0);
-        x_min_ = root.pos.x - root.r;
-        y_min_ = root.pos.y - root.r;
-        x_max_ = root.pos.x + root.r;
-        y_max_ = root.pos.y + root.r;
-
-        for (auto &[_, n] : net_->nodes()) {
-            if (n.pos.x - n.r < x_min_) x_min_ = n.pos.x - n.r;
-            if (n.pos.y - n.r < y_min_) y_min_ = n.pos.y - n.r;
-            if (n.pos.x + n.r > x_max_) x_max_ = n.pos.x + n.r;
-            if (n.pos.y + n.r > y_max_) y_max_ = n.pos.y + n.r;
+        const BBox &box = net_->bounds();
+        if (!box.empty()) {
+            x_min_ = box.lo.x;
+            y_min_ = box.lo.y;
+            x_max_ = box.hi.x;
+            y_max_ = box.hi.y;
         }
 
         const double SF_MIN = 0.0001;
@@ -79,6 +79,17 @@ public:
     /** Stop animating. */
     void StopAnimation();
 
+    /** Resume an animation that stopped by itself because the simulation
+    * converged. Call whenever the simulation is disturbed, e.g. when a
+    * Constant changes. Does nothing unless the animation was started.
+    */
+    void WakeAnimation();
+
+    /** Check if the animation was started and not stopped by StopAnimation.
+    * The Canvas may still be idle because the simulation has settled.
+    */
+    bool IsAnimating() const { return animating_; }
+
     /** Check if Canvas is auto tracking. */
     bool GetAutoTrack() const { return auto_track_; }
 
@@ -131,6 +142,10 @@ private:
     bool auto_track_ = true;       //if true, camera will pan and zoom to fit entire network on screen
 
     size_t iterations_per_frame_ = 3; //number of steps to simulate between draw calls
+    float settle_tolerance_ = 0.005f; //animation_timer_ stops when no node moves farther than this per step...
+    size_t settle_frames_ = 10;       //...for this many consecutive frames
+    size_t settled_frames_ = 0;       //number of consecutive frames for which the simulation has been settled
+    bool animating_ = false;          //true between StartAnimation and StopAnimation even if settled
     wxTimer animation_timer_;         //periodically update and paint simulation
     wxTimer tooltip_timer_;           //delay on hover before tooltip is shown
 
@@ -0,0 +1,134 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <tuple>
+
+#include "clone_index.h"
+
+//first line of a sidecar index, bumped when the format changes
+constexpr const char *CLONE_INDEX_MAGIC = "dandelions clone index 1";
+
+/** Get the size and modification time of the file at path, nullopt if it can't be read. */
+std::optional<std::pair<uint64_t, int64_t>>
+file_stamp(const std::filesystem::path &path) {
+    std::error_code ec;
+    const uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec) return std::nullopt;
+    const auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) return std::nullopt;
+    return std::make_pair(size, static_cast<int64_t>(mtime.time_since_epoch().count()));
+}
+
+CloneIndex::CloneIndex(const std::filesystem::path &path) {
+    if (auto stamp = file_stamp(path)) std::tie(file_size, mtime) = *stamp;
+}
+
+size_t
+CloneIndex::add_clone(std::string id) {
+    ids.push_back(std::move(id));
+    rows.push_back(0);
+    ranges.emplace_back();
+    return ids.size() - 1;
+}
+
+void
+CloneIndex::add_row(size_t i, Range range) {
+    if (i >= ids.size()) throw std::out_of_range("clone index out of range");
+    ++rows[i];
+    std::vector<Range> &r = ranges[i];
+    if (!r.empty() && r.back().offset + r.back().size == range.offset) r.back().size += range.size;
+    else r.push_back(range);
+}
+
+std::filesystem::path
+clone_index_path(const std::filesystem::path &path) {
+    std::filesystem::path sidecar = path;
+    sidecar += ".clones";
+    return sidecar;
+}
+
+std::optional<CloneIndex>
+read_clone_index(const std::filesystem::path &path) {
+    auto stamp = file_stamp(path);
+    std::ifstream ifs(clone_index_path(path), std::ios::binary);
+    if (!stamp || !ifs) return std::nullopt;
+
+    //line 1 is the magic, line 2 the table's stamp and header, then one line per clone:
+    //id <tab> rows <tab> offset:size <tab> offset:size ...
+    CloneIndex index;
+    std::string line;
+    if (!std::getline(ifs, line) || line != CLONE_INDEX_MAGIC) return std::nullopt;
+    if (!std::getline(ifs, line)) return std::nullopt;
+    std::istringstream stamp_line(line);
+    char colon = 0;
+    if (!(stamp_line >> index.file_size >> index.mtime >> index.header.offset >> colon >> index.header.size) || colon != ':')
+        return std::nullopt;
+    if (index.file_size != stamp->first || index.mtime != stamp->second) return std::nullopt;
+
+    while (std::getline(ifs, line)) {
+        const size_t tab = line.find('\t');
+        if (tab == std::string::npos) return std::nullopt;
+        index.ids.push_back(line.substr(0, tab));
+        index.ranges.emplace_back();
+        std::istringstream fields(line.substr(tab + 1));
+        size_t rows = 0;
+        if (!(fields >> rows)) return std::nullopt;
+        index.rows.push_back(rows);
+        CloneIndex::Range r;
+        while (fields >> r.offset >> colon >> r.size) {
+            if (colon != ':' || r.offset + r.size > index.file_size) return std::nullopt;
+            index.ranges.back().push_back(r);
+        }
+        if (!fields.eof()) return std::nullopt;
+    }
+    return index;
+}
+
+bool
+write_clone_index(const std::filesystem::path &path, const CloneIndex &index) {
+    //written next to the final name and renamed so readers never see half an index
+    const std::filesystem::path sidecar = clone_index_path(path);
+    std::filesystem::path tmp = sidecar;
+    tmp += ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary);
+        if (!ofs) return false;
+        ofs << CLONE_INDEX_MAGIC << "\n"
+            << index.file_size << " " << index.mtime << " " << index.header.offset << ":" << index.header.size << "\n";
+        for (size_t i = 0; i < index.ids.size(); ++i) {
+            ofs << index.ids[i] << "\t" << index.rows[i];
+            for (const CloneIndex::Range &r : index.ranges[i]) ofs << "\t" << r.offset << ":" << r.size;
+            ofs << "\n";
+        }
+        if (!ofs.flush()) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, sidecar, ec);
+    if (!ec) return true;
+    std::filesystem::remove(tmp, ec);
+    return false;
+}
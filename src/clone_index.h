@@ -0,0 +1,79 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CCB_CLONE_INDEX_H_
+#define CCB_CLONE_INDEX_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+/** Where the rows of each clone of a multi-clone table lie in the file, so a
+* single lineage can be read without parsing the rest. The index is kept in
+* a sidecar file next to the table and is only valid while the table's size
+* and modification time are those it was built for.
+*/
+struct CloneIndex {
+    /** A run of whole lines in the table. */
+    struct Range {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    uint64_t file_size = 0;
+    int64_t mtime = 0;
+    Range header;
+    std::vector<std::string> ids;
+    std::vector<size_t> rows;                //the number of rows of each clone
+    std::vector<std::vector<Range>> ranges;  //each clone's rows, in file order
+
+    /** Start an empty index for the table at path as it is now. */
+    explicit CloneIndex(const std::filesystem::path &path);
+    CloneIndex() = default;
+
+    /** Add a clone with no rows, return its index. */
+    size_t add_clone(std::string id);
+
+    /** Add the row at range to clone i, merging it with the clone's last range if adjacent. */
+    void add_row(size_t i, Range range);
+};
+
+/** Get the path of the sidecar index of the table at path. */
+std::filesystem::path
+clone_index_path(const std::filesystem::path &path);
+
+/** Read the sidecar index of the table at path.
+* @return nullopt if there is none, it can't be read or the table changed since it was built
+*/
+std::optional<CloneIndex>
+read_clone_index(const std::filesystem::path &path);
+
+/** Write the sidecar index of the table at path, replacing any old one.
+* @return false if it couldn't be written, e.g. the directory is read-only
+*/
+bool
+write_clone_index(const std::filesystem::path &path, const CloneIndex &index);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdexcept>
+
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define CCB_HAVE_ZLIB 1
+#endif
+
+#include "gzip_stream.h"
+
+GzipStreamBuf::GzipStreamBuf(const std::filesystem::path &path) {
+    #ifndef CCB_HAVE_ZLIB
+    throw std::runtime_error("Compressed input is not supported by this build.");
+    #endif
+    constexpr size_t N_BLOCKS = 4;
+
+    file_.open(path, std::ios::binary);
+    if (!file_) throw std::runtime_error("File " + path.string() + " could not be opened for reading.");
+
+    free_.resize(N_BLOCKS);
+    worker_ = std::thread(&GzipStreamBuf::inflate_worker, this);
+}
+
+GzipStreamBuf::~GzipStreamBuf() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (worker_.joinable()) worker_.join();
+}
+
+GzipStreamBuf::int_type
+GzipStreamBuf::underflow() {
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (current_.capacity()) {
+        free_.push_back(std::move(current_));
+        current_ = std::vector<char>();
+        cv_.notify_all();
+    }
+
+    cv_.wait(lock, [this]() { return !ready_.empty() || done_; });
+    if (ready_.empty()) {
+        if (!error_.empty()) throw std::runtime_error(error_);
+        return traits_type::eof();
+    }
+
+    current_ = std::move(ready_.front());
+    ready_.pop_front();
+    setg(current_.data(), current_.data(), current_.data() + current_.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+void
+GzipStreamBuf::inflate_worker() {
+    #ifdef CCB_HAVE_ZLIB
+    constexpr size_t BLOCK_SIZE = 1 << 22;
+    constexpr size_t READ_SIZE = 1 << 20;
+
+    std::string error;
+    z_stream zs{};
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) error = "Could not initialize zlib.";  //15 + 32: gzip or zlib header
+
+    std::vector<char> in(READ_SIZE);
+    bool end = !error.empty();
+    bool between_members = false;
+    while (!end) {
+        std::vector<char> block;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stop_ || !free_.empty(); });
+            if (stop_) break;
+            block = std::move(free_.back());
+            free_.pop_back();
+        }
+
+        block.resize(BLOCK_SIZE);
+        zs.next_out = reinterpret_cast<Bytef *>(block.data());
+        zs.avail_out = static_cast<uInt>(block.size());
+        while (zs.avail_out && !end) {
+            if (zs.avail_in == 0) {
+                file_.read(in.data(), in.size());
+                zs.next_in = reinterpret_cast<Bytef *>(in.data());
+                zs.avail_in = static_cast<uInt>(file_.gcount());
+                if (zs.avail_in == 0) {
+                    if (!between_members) error = "Compressed file is truncated.";
+                    end = true;
+                    break;
+                }
+            }
+
+            const int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                //another gzip member may follow
+                inflateReset(&zs);
+                between_members = true;
+            } else if (ret == Z_OK) {
+                between_members = false;
+            } else if (between_members && ret == Z_DATA_ERROR) {
+                end = true; //trailing garbage, e.g. zero padding, is ignored like gzip does
+            } else if (ret != Z_BUF_ERROR) {
+                error = std::string("Compressed file is corrupt: ") + (zs.msg ? zs.msg : "unknown error");
+                end = true;
+            }
+        }
+        block.resize(block.size() - zs.avail_out);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (block.empty()) {
+            free_.push_back(std::move(block));
+        } else {
+            ready_.push_back(std::move(block));
+        }
+        cv_.notify_all();
+    }
+    inflateEnd(&zs);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+        error_ = error;
+    }
+    cv_.notify_all();
+    #endif
+}
+
+GzipIStream::GzipIStream(const std::filesystem::path &path)
+    : std::istream(nullptr)
+    , buf_(path) {
+    rdbuf(&buf_);
+    exceptions(std::ios::badbit);
+}
+
+bool
+is_gzip(const std::filesystem::path &path) {
+    std::ifstream ifs(path, std::ios::binary);
+    unsigned char magic[2] = {0, 0};
+    ifs.read(reinterpret_cast<char *>(magic), 2);
+    return ifs.gcount() == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+std::unique_ptr<std::istream>
+open_input(const std::filesystem::path &path) {
+    if (is_gzip(path)) return std::make_unique<GzipIStream>(path);
+
+    auto ifs = std::make_unique<std::ifstream>(path);
+    if (!*ifs) throw std::runtime_error("File " + path.string() + " could not be opened for reading.");
+    return ifs;
+}
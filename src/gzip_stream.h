@@ -0,0 +1,93 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CCB_GZIP_STREAM_H_
+#define CCB_GZIP_STREAM_H_
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** A read-only streambuf over a gzip (or zlib) compressed file. A separate
+* thread inflates the file into a few large blocks ahead of the reader, so
+* decompression overlaps whatever consumes the stream. Concatenated gzip
+* members are read as one stream.
+* Decompression errors are thrown as std::runtime_error from underflow().
+* Without zlib at build time the constructor throws std::runtime_error.
+*/
+struct GzipStreamBuf : std::streambuf {
+    /** Open path and start inflating it, throws std::runtime_error if it can't be opened. */
+    explicit GzipStreamBuf(const std::filesystem::path &path);
+    ~GzipStreamBuf();
+
+    GzipStreamBuf(const GzipStreamBuf &) = delete;
+    GzipStreamBuf &operator=(const GzipStreamBuf &) = delete;
+
+protected:
+    int_type underflow() override;
+
+private:
+    /** Inflate file_ into free blocks and queue them until done or stopped. */
+    void inflate_worker();
+
+    std::ifstream file_;
+    std::vector<char> current_;             //block being read from
+    std::deque<std::vector<char>> ready_;   //inflated blocks in order
+    std::vector<std::vector<char>> free_;   //blocks available to the worker
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool done_ = false;
+    bool stop_ = false;
+    std::string error_;
+    std::thread worker_;
+};
+
+/** An std::istream reading a gzip compressed file, see GzipStreamBuf.
+* badbit is in exceptions() so decompression errors reach the caller.
+*/
+struct GzipIStream : std::istream {
+    explicit GzipIStream(const std::filesystem::path &path);
+
+private:
+    GzipStreamBuf buf_;
+};
+
+/** Check if the file at path starts with the gzip magic bytes. */
+bool
+is_gzip(const std::filesystem::path &path);
+
+/** Open path for reading, decompressing it on the fly if it is gzip compressed.
+* @throw std::runtime_error if it can't be opened
+*/
+std::unique_ptr<std::istream>
+open_input(const std::filesystem::path &path);
+
+#endif
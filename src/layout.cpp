@@ -0,0 +1,531 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "layout.h"
+#include "matrix.h"
+#include "network.h"
+
+/** One level of the multilevel hierarchy. Index 0 is the root and
+* parents always precede their children.
+*/
+struct LayoutLevel {
+    std::vector<uint32_t> parent; //parent[0] is unused
+    std::vector<uint32_t> group;  //index of the node in the next coarser level that absorbed each node
+    std::vector<uint8_t>  merged; //1 if the node was merged into its parent, 0 if it represents its group
+    std::vector<float>    length;
+    std::vector<float>    mass;
+    std::vector<double>   r;
+    std::vector<Vec2>     pos;
+
+    size_t size() const { return parent.size(); }
+};
+
+/** Build the next coarser level and fill in fine.group and fine.merged. */
+LayoutLevel
+coarsen(LayoutLevel &fine) {
+    const size_t n = fine.size();
+
+    //walking backward visits every child before its parent; a node merges
+    //into its parent unless one of its own children already merged into it
+    std::vector<uint8_t> absorbing(n, 0);
+    fine.merged.assign(n, 0);
+    for (size_t v = n - 1; v > 0; --v) {
+        if (!absorbing[v]) {
+            fine.merged[v] = 1;
+            absorbing[fine.parent[v]] = 1;
+        }
+    }
+
+    LayoutLevel coarse;
+    fine.group.assign(n, 0);
+    for (size_t v = 0; v < n; ++v) {
+        if (fine.merged[v]) {
+            const uint32_t g = fine.group[fine.parent[v]];
+            fine.group[v] = g;
+            coarse.mass[g] += fine.mass[v];
+            coarse.r[g] += fine.r[v] * fine.r[v];
+        } else {
+            fine.group[v] = static_cast<uint32_t>(coarse.size());
+            coarse.parent.push_back(v ? fine.group[fine.parent[v]] : 0);
+            coarse.length.push_back(fine.length[v]);
+            coarse.mass.push_back(fine.mass[v]);
+            coarse.r.push_back(fine.r[v] * fine.r[v]);
+        }
+    }
+    for (double &r : coarse.r) r = std::sqrt(r); //groups keep the total area of their members
+    coarse.pos.resize(coarse.size());
+
+    return coarse;
+}
+
+/** Place the nodes of fine using the positions of coarse. Group representatives
+* take the position of their group, merged nodes are fanned out around it at
+* their spring rest length.
+*/
+void
+prolong(LayoutLevel &fine, const LayoutLevel &coarse, float E) {
+    constexpr float GOLDEN_ANGLE = 2.39996323f;
+    std::vector<uint32_t> fanned(coarse.size(), 0);
+
+    for (size_t v = 0; v < fine.size(); ++v) {
+        const uint32_t g = fine.group[v];
+        const Vec2 center = coarse.pos[g];
+        if (!fine.merged[v]) {
+            fine.pos[v] = center;
+            continue;
+        }
+
+        //start fanning out on the side facing away from the group's parent
+        float base = 0.0f;
+        if (g != 0) {
+            const Vec2 away = coarse.pos[coarse.parent[g]];
+            base = std::atan2(center.y - away.y, center.x - away.x);
+        }
+        const float theta = base + GOLDEN_ANGLE * fanned[g]++;
+        const float d = E * static_cast<float>(fine.length[v] + fine.r[v] + fine.r[fine.parent[v]]);
+        fine.pos[v] = Vec2(center.x + d * std::cos(theta), center.y + d * std::sin(theta));
+    }
+}
+
+/** Run the physics simulation on a level using the constants of net.
+* @param seeded if true, start from level.pos, otherwise from a radial layout
+* @return the number of steps simulated
+*/
+size_t
+simulate_level(const Network &net, LayoutLevel &level, size_t max_steps, bool seeded) {
+    constexpr float TOLERANCE = 0.01f;
+
+    Network sim;
+    for (size_t i = 0; i < level.size(); ++i) {
+        Node &n = sim.add_node(i);
+        n.r = level.r[i];
+        n.mass = level.mass[i];
+        n.pos = level.pos[i];
+    }
+    for (size_t i = 1; i < level.size(); ++i) sim.add_edge(level.parent[i], i, level.length[i]);
+    for (const auto &[c, k] : net.constants()) sim.constant(c) = k;
+    if (net.deterministic()) sim.set_deterministic(true, net.seed());
+
+    sim.init_simulation();
+    if (seeded) {
+        for (size_t i = 0; i < level.size(); ++i) sim.node(i).pos = level.pos[i];
+        sim.load_positions();
+    } else {
+        radial_layout(sim);
+    }
+    sim.pin_node(0);
+
+    size_t steps = sim.run_until_converged(TOLERANCE, max_steps);
+    for (size_t i = 0; i < level.size(); ++i) level.pos[i] = sim.node(i).pos;
+    return steps;
+}
+
+size_t
+multilevel_layout(Network &net, size_t refine_steps) {
+    constexpr size_t MIN_NODES = 64;      //stop coarsening once a level is this small...
+    constexpr double MIN_SHRINK = 0.9;    //...or when coarsening stops paying off
+    constexpr size_t COARSE_FACTOR = 20;  //the coarsest level gets this many times refine_steps
+    constexpr double PAIR_BUDGET = 5e8;   //pairwise force evaluations allowed per level
+
+    if (net.nodes().empty()) return 0;
+
+    //number the nodes in breadth first order so parents precede children
+    std::vector<Node *> order;
+    std::unordered_map<const Node *, uint32_t> index;
+    order.push_back(&net.node(0));
+    for (size_t i = 0; i < order.size(); ++i) {
+        index[order[i]] = static_cast<uint32_t>(i);
+        for (Node *c : *order[i]) order.push_back(c);
+    }
+
+    std::vector<LayoutLevel> levels(1);
+    for (Node *n : order) {
+        LayoutLevel &finest = levels.front();
+        finest.parent.push_back(n->is_root() ? 0 : index.at(n->parent()));
+        finest.length.push_back(n->length);
+        finest.mass.push_back(n->mass);
+        finest.r.push_back(n->r);
+    }
+    levels.front().pos.resize(order.size());
+
+    while (levels.back().size() > MIN_NODES) {
+        LayoutLevel coarse = coarsen(levels.back());
+        if (coarse.size() > MIN_SHRINK * levels.back().size()) break;
+        levels.push_back(std::move(coarse));
+    }
+
+    //a step costs O(n^2) so the biggest levels get fewer steps, at least one
+    auto budget = [&](const LayoutLevel &level, size_t max_steps)->size_t {
+        const double pairs = static_cast<double>(level.size()) * level.size();
+        return std::clamp<size_t>(static_cast<size_t>(PAIR_BUDGET / pairs), 1, max_steps);
+    };
+
+    const float E = net.constant('E').value();
+    size_t steps = 0;
+
+    if (levels.size() > 1) {
+        steps += simulate_level(net, levels.back(), budget(levels.back(), COARSE_FACTOR * refine_steps), false);
+        for (size_t k = levels.size() - 1; k-- > 1; ) {
+            prolong(levels[k], levels[k + 1], E);
+            steps += simulate_level(net, levels[k], budget(levels[k], refine_steps), true);
+        }
+        prolong(levels[0], levels[1], E);
+    } else {
+        steps += simulate_level(net, levels[0], budget(levels[0], COARSE_FACTOR * refine_steps), false);
+    }
+
+    //keep the root where it was so a pinned root stays put
+    const LayoutLevel &finest = levels.front();
+    const Vec2 root = order.front()->pos;
+    const Vec2 offset(root.x - finest.pos[0].x, root.y - finest.pos[0].y);
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i]->pos = finest.pos[i];
+        order[i]->pos += offset;
+    }
+
+    //refining the full size network takes O(n^2) per step, so that is left to
+    //the caller, e.g. the animated simulation on the canvas
+    net.load_positions();
+    return steps;
+}
+
+void
+radial_layout(Network &net) {
+    if (net.nodes().empty()) return;
+
+    //breadth first order so parents precede children
+    std::vector<Node *> order;
+    std::vector<uint32_t> parent;
+    order.push_back(&net.node(0));
+    parent.push_back(0);
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (Node *c : *order[i]) {
+            order.push_back(c);
+            parent.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    //count the leaves in every subtree, children before parents
+    std::vector<uint32_t> leaves(order.size(), 0);
+    for (size_t i = order.size(); i-- > 0; ) {
+        if (0 == leaves[i]) leaves[i] = 1;
+        if (i) leaves[parent[i]] += leaves[i];
+    }
+
+    //each node owns the wedge [lo, lo + width) and hands it out to its children
+    //in proportion to their leaves; next[p] is where p's next child starts
+    const float E = net.constant('E').value();
+    std::vector<float> lo(order.size(), 0.0f), width(order.size(), 0.0f), next(order.size(), 0.0f);
+    std::vector<float> radius(order.size(), 0.0f);
+    width[0] = 2.0f * std::numbers::pi_v<float>;
+
+    //a node's distance from the root is its path length in spring rest lengths
+    const Vec2 origin = order[0]->pos;
+    for (size_t i = 1; i < order.size(); ++i) {
+        const uint32_t p = parent[i];
+        Node &n = *order[i];
+
+        lo[i] = lo[p] + next[p];
+        width[i] = width[p] * leaves[i] / leaves[p];
+        next[p] += width[i];
+
+        radius[i] = radius[p] + E * static_cast<float>(n.length + n.r + order[p]->r);
+        const float theta = lo[i] + width[i] / 2.0f;
+        n.pos = Vec2(origin.x + radius[i] * std::cos(theta), origin.y + radius[i] * std::sin(theta));
+    }
+
+    net.load_positions();
+}
+
+/** Tree in breadth first order with contiguous children, as used by stress_layout. */
+struct StressTree {
+    std::vector<Node *>   order;
+    std::vector<uint32_t> parent;   //parent[0] is unused
+    std::vector<uint32_t> child_lo; //children of i are [child_lo[i], child_hi[i])
+    std::vector<uint32_t> child_hi;
+    std::vector<float>    length;   //target length of the edge from parent[i] to i
+};
+
+/** Fill dist with the path length from s to every node of t. */
+void
+tree_distances(const StressTree &t, uint32_t s, std::span<float> dist) {
+    thread_local std::vector<uint32_t> stack;
+    stack.clear();
+    std::fill(dist.begin(), dist.end(), -1.0f);
+    dist[s] = 0.0f;
+    stack.push_back(s);
+    while (!stack.empty()) {
+        const uint32_t v = stack.back();
+        stack.pop_back();
+        if (v != 0 && dist[t.parent[v]] < 0.0f) {
+            dist[t.parent[v]] = dist[v] + t.length[v];
+            stack.push_back(t.parent[v]);
+        }
+        for (uint32_t c = t.child_lo[v]; c != t.child_hi[v]; ++c) {
+            if (dist[c] < 0.0f) {
+                dist[c] = dist[v] + t.length[c];
+                stack.push_back(c);
+            }
+        }
+    }
+}
+
+/** Compute one localized majorization update for nodes in [lo, hi). Reads
+* positions x, y and writes the new positions to nx, ny and each node's share
+* of the (sparse) stress of x, y to stress.
+*/
+void
+stress_step_worker(
+    size_t lo,
+    size_t hi,
+    const StressTree &t,
+    const std::vector<uint32_t> &pivots,
+    const std::vector<float> &pivot_weight,
+    const Matrix<float> &pivot_dist,
+    const std::vector<float> &x,
+    const std::vector<float> &y,
+    std::vector<float> &nx,
+    std::vector<float> &ny,
+    std::vector<double> &stress) {
+
+    constexpr float EPSILON = 0.0001f;
+
+    for (size_t i = lo; i != hi; ++i) {
+        double sum_w = 0.0, sum_x = 0.0, sum_y = 0.0, sum_s = 0.0;
+
+        //pull towards x_j + d_ij * unit(x_i - x_j) with weight w_ij
+        auto term = [&](uint32_t j, float d, float w) {
+            float dx = x[i] - x[j];
+            float dy = y[i] - y[j];
+            float r = std::max(std::sqrt(dx * dx + dy * dy), EPSILON);
+            sum_w += w;
+            sum_x += w * (x[j] + d * dx / r);
+            sum_y += w * (y[j] + d * dy / r);
+            sum_s += w * (r - d) * (r - d);
+        };
+
+        if (i != 0) term(t.parent[i], t.length[i], 1.0f / (t.length[i] * t.length[i]));
+        for (uint32_t c = t.child_lo[i]; c != t.child_hi[i]; ++c) {
+            term(c, t.length[c], 1.0f / (t.length[c] * t.length[c]));
+        }
+        for (size_t k = 0; k != pivots.size(); ++k) {
+            const float d = pivot_dist[{k, i}];
+            if (d <= EPSILON) continue; //i is the pivot
+            term(pivots[k], d, pivot_weight[k] / (d * d));
+        }
+
+        if (sum_w > 0.0) {
+            nx[i] = static_cast<float>(sum_x / sum_w);
+            ny[i] = static_cast<float>(sum_y / sum_w);
+        } else {
+            nx[i] = x[i];
+            ny[i] = y[i];
+        }
+        stress[i] = sum_s;
+    }
+}
+
+size_t
+stress_layout(Network &net, size_t max_iterations, size_t n_pivots) {
+    constexpr double TOLERANCE = 0.001; //stop when an iteration lowers the stress by less than this fraction
+
+    if (net.nodes().empty()) return 0;
+
+    radial_layout(net);
+
+    //number nodes breadth first so each node's children are contiguous
+    StressTree t;
+    const float E = net.constant('E').value();
+    t.order.push_back(&net.node(0));
+    t.parent.push_back(0);
+    t.length.push_back(0.0f);
+    for (size_t i = 0; i < t.order.size(); ++i) {
+        t.child_lo.push_back(static_cast<uint32_t>(t.order.size()));
+        for (Node *c : *t.order[i]) {
+            t.order.push_back(c);
+            t.parent.push_back(static_cast<uint32_t>(i));
+            t.length.push_back(std::max(E * static_cast<float>(c->length + c->r + t.order[i]->r), 0.0001f));
+        }
+        t.child_hi.push_back(static_cast<uint32_t>(t.order.size()));
+    }
+
+    const size_t n = t.order.size();
+    if (n < 2) return 0;
+
+    //choose pivots by max-min distance starting from the root
+    const size_t k = std::min(n, n_pivots);
+    std::vector<uint32_t> pivots;
+    Matrix<float> pivot_dist(k, n);
+    std::vector<float> nearest(n, std::numeric_limits<float>::max());
+    std::vector<uint32_t> region(n, 0);
+    for (uint32_t p = 0; pivots.size() != k; ) {
+        const size_t row = pivots.size();
+        pivots.push_back(p);
+        tree_distances(t, p, pivot_dist[row]);
+        for (size_t i = 0; i != n; ++i) {
+            if (pivot_dist[{row, i}] < nearest[i]) {
+                nearest[i] = pivot_dist[{row, i}];
+                region[i] = static_cast<uint32_t>(row);
+            }
+        }
+        p = static_cast<uint32_t>(std::max_element(nearest.begin(), nearest.end()) - nearest.begin());
+    }
+
+    //a pivot stands in for every node in its region
+    std::vector<float> pivot_weight(k, 0.0f);
+    for (uint32_t r : region) pivot_weight[r] += 1.0f;
+
+    std::vector<float> x(n), y(n), nx(n), ny(n);
+    std::vector<double> stress(n, 0.0);
+    for (size_t i = 0; i != n; ++i) {
+        x[i] = t.order[i]->pos.x;
+        y[i] = t.order[i]->pos.y;
+    }
+
+    const size_t n_workers = std::min<size_t>(n, std::max(1U, std::thread::hardware_concurrency()));
+    const size_t chunk = (n + n_workers - 1) / n_workers;
+
+    size_t iteration = 0;
+    double previous = std::numeric_limits<double>::max();
+    while (iteration < max_iterations) {
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w != n_workers; ++w) {
+            threads.push_back(
+                std::thread(
+                    stress_step_worker,
+                    std::min(n, w * chunk),
+                    std::min(n, (w + 1) * chunk),
+                    std::cref(t),
+                    std::cref(pivots),
+                    std::cref(pivot_weight),
+                    std::cref(pivot_dist),
+                    std::cref(x),
+                    std::cref(y),
+                    std::ref(nx),
+                    std::ref(ny),
+                    std::ref(stress)
+                )
+            );
+        }
+        for (std::thread &th : threads) th.join();
+
+        std::swap(x, nx);
+        std::swap(y, ny);
+        ++iteration;
+
+        //summing in node order keeps the result independent of the number of threads
+        double total = 0.0;
+        for (double si : stress) total += si;
+        if (previous - total < TOLERANCE * previous) break;
+        previous = total;
+    }
+
+    //keep the root where it was so a pinned root stays put
+    const Vec2 root = t.order[0]->pos;
+    for (size_t i = 0; i != n; ++i) {
+        t.order[i]->pos = Vec2(x[i] - x[0] + root.x, y[i] - y[0] + root.y);
+    }
+
+    net.load_positions();
+    return iteration;
+}
+
+size_t
+warm_start_layout(Network &net, const Network &previous, float min_carried) {
+    if (net.nodes().empty()) return 0;
+
+    //consolidation may pick a different representative for a group of
+    //synonymous sequences so translations are the fallback key
+    std::unordered_map<std::string_view, const Node *> by_nts, by_aas;
+    for (const Node &n : previous) {
+        if (!n.nts().empty()) by_nts.try_emplace(n.nts(), &n);
+        if (!n.aas().empty()) by_aas.try_emplace(n.aas(), &n);
+    }
+
+    //breadth first so parents are placed before their children
+    std::vector<Node *> order{&net.node(0)};
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (Node *c : *order[i]) order.push_back(c);
+    }
+
+    //each previous Node lends its position to one Node at most, so two
+    //distinct Nodes never start on top of each other
+    std::unordered_map<const Node *, const Node *> source;
+    std::unordered_set<const Node *> used;
+    for (Node *n : order) {
+        const Node *old = nullptr;
+        if (auto ii = by_nts.find(n->nts()); ii != by_nts.end() && !used.contains(ii->second)) old = ii->second;
+        else if (auto ii = by_aas.find(n->aas()); ii != by_aas.end() && !used.contains(ii->second)) old = ii->second;
+        if (old) {
+            source.emplace(n, old);
+            used.insert(old);
+        }
+    }
+
+    //an unrelated lineage that shares little more than its germline is better
+    //served by a fresh layout
+    if (source.size() < min_carried * static_cast<float>(net.nodes().size())) return 0;
+
+    constexpr float GOLDEN_ANGLE = 2.39996323f;
+    const float E = net.constant('E').value();
+    std::unordered_map<const Node *, uint32_t> fanned;
+    std::unordered_set<const Node *> settled;
+
+    for (Node *n : order) {
+        if (auto ii = source.find(n); ii != source.end()) {
+            n->pos = ii->second->pos;
+
+            //a carried Node is only at rest if its spring is the one it had
+            const Node *p = n->parent();
+            auto pi = p ? source.find(p) : source.end();
+            if (!p || (pi != source.end() && pi->second == ii->second->parent())) settled.insert(n);
+            continue;
+        }
+        if (n->is_root()) continue;
+
+        //fan new nodes out around their parent, starting on the side facing
+        //away from the grandparent
+        const Node *p = n->parent();
+        float base = 0.0f;
+        if (!p->is_root()) base = std::atan2(p->pos.y - p->parent()->pos.y, p->pos.x - p->parent()->pos.x);
+        const float theta = base + GOLDEN_ANGLE * fanned[p]++;
+        const float d = E * static_cast<float>(n->length + n->r + p->r);
+        n->pos = Vec2(p->pos.x + d * std::cos(theta), p->pos.y + d * std::sin(theta));
+    }
+
+    net.load_positions(settled);
+    return source.size();
+}
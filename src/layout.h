@@ -0,0 +1,89 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CCB_LAYOUT_H_
+#define CCB_LAYOUT_H_
+
+#include <cstddef>
+
+struct Network;
+
+/** Lay out a Network with a multilevel scheme that exploits the tree hierarchy.
+* The tree is coarsened by repeatedly merging every node that has not yet absorbed
+* a child of its own (e.g. every leaf) into its parent until only a few nodes
+* remain. The coarsest tree is laid out by the physics simulation starting from
+* radial_layout(), then positions are prolonged level by level, each followed by only a few
+* refinement steps, fewer on big levels. The full size network itself is not
+* simulated; that is left to the caller (e.g. the canvas animation). The result is
+* left in Node::pos and in the simulation state of net; the root keeps its current position.
+* @param net a Network on which init_simulation() has been called
+* @param refine_steps maximum number of simulation steps at each coarse level
+* @return the total number of simulation steps taken over all levels
+*/
+size_t
+multilevel_layout(Network &net, size_t refine_steps = 50);
+
+/** Deterministic radial tree layout in O(n). Each subtree gets an angular
+* wedge around the root proportional to its number of leaves and every Node is
+* placed in the middle of its wedge at its path length from the root, measured
+* in spring rest lengths (scaled by Constant E). Useful as a final layout for trees too large for the physics
+* simulation or as a starting point for it. The result is left in Node::pos and
+* in the simulation state of net; the root keeps its current position.
+* @param net a Network on which init_simulation() has been called
+*/
+void
+radial_layout(Network &net);
+
+/** Stress majorization (SMACOF) layout. Target distances are tree path lengths
+* measured in spring rest lengths (scaled by Constant E), so the result does not
+* depend on the other simulation Constants. For large trees the stress is
+* approximated sparsely: every Node interacts with its tree neighbors and with
+* a set of pivots chosen by max-min distance, and each pivot term is weighted
+* by the number of Nodes closest to that pivot. With at least as many pivots as
+* Nodes the full stress is minimized. Starts from radial_layout(), converges
+* deterministically and each iteration runs on all cores. The result is left in
+* Node::pos and in the simulation state of net; the root keeps its position.
+* @param net a Network on which init_simulation() has been called
+* @param max_iterations upper limit on the number of majorization iterations
+* @param n_pivots the number of pivots
+* @return the number of iterations performed
+*/
+size_t
+stress_layout(Network &net, size_t max_iterations = 100, size_t n_pivots = 256);
+
+/** Carry the layout of a previous Network over to net by sequence identity.
+* Nodes whose nucleotide sequence, or failing that, translation, appeared in
+* previous keep their old position, each old position going to one Node only.
+* Those whose parent also carried over from the old parent start out settled
+* (see Network::load_positions()). New Nodes are fanned out around their parent
+* at their spring rest length, so only the changed regions need to converge.
+* The result is left in Node::pos and in the simulation state of net.
+* @param net a Network on which init_simulation() has been called
+* @param previous the Network whose positions are carried over
+* @param min_carried the fraction of Nodes that must carry over, below it net is left untouched
+* @return the number of Nodes that kept a previous position, 0 if net was left untouched
+*/
+size_t
+warm_start_layout(Network &net, const Network &previous, float min_carried = 0.5f);
+
+#endif
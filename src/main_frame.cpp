@@ -24,15 +24,19 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <array>
 #include <filesystem>
 #include <fstream>
+#include <limits>
 #include <memory>
 #include <numbers>
 #include <numeric>
+#include <optional>
 
 #include <wx/gbsizer.h>
 #include <wx/numdlg.h>
 
+#include "gzip_stream.h"
 #include "main_frame.h"
 #include "network.h"
+#include "layout.h"
 #include "muttable.h"
 #include "parsers.h"
 #include "tree.h"
@@ -57,6 +61,13 @@ MainFrame::MainFrame(const wxString &title, const wxPoint &pos, const wxSize &si
     wxMenu *menuEdit = new wxMenu;
     menuEdit->Append(ID_EDIT_STYLE, "Style");
 
+    wxMenu *menuLayout = new wxMenu;
+    menuLayout->Append(ID_LAYOUT_MULTILEVEL, "Multilevel");
+    menuLayout->Append(ID_LAYOUT_RADIAL, "Radial");
+    menuLayout->Append(ID_LAYOUT_STRESS, "Stress Majorization");
+    menuLayout->AppendSeparator();
+    menuLayout->AppendCheckItem(ID_LAYOUT_DETERMINISTIC, "Reproducible Simulation");
+
     wxMenu *menuHelp = new wxMenu;
     #ifdef WIN32
     menuHelp->Append(ID_HELP_CONSOLE, "Show Console");
@@ -66,6 +77,7 @@ MainFrame::MainFrame(const wxString &title, const wxPoint &pos, const wxSize &si
     wxMenuBar *menuBar = new wxMenuBar;
     menuBar->Append(menuFile, "&File");
     menuBar->Append(menuEdit, "&Edit");
+    menuBar->Append(menuLayout, "&Layout");
     menuBar->Append(menuHelp, "&Help");
     SetMenuBar(menuBar);
     CreateStatusBar();
@@ -124,6 +136,10 @@ MainFrame::MainFrame(const wxString &title, const wxPoint &pos, const wxSize &si
 
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnOpen,            this, wxID_OPEN);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnEditStyle,       this, ID_EDIT_STYLE);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnLayout,          this, ID_LAYOUT_MULTILEVEL);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnLayout,          this, ID_LAYOUT_RADIAL);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnLayout,          this, ID_LAYOUT_STRESS);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnDeterministic,   this, ID_LAYOUT_DETERMINISTIC);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnExportGraphic,   this, ID_EXPORT_GRAPHIC);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnExportTable,     this, ID_EXPORT_TABLE);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnExportSequences, this, ID_EXPORT_SEQUENCES);
@@ -166,13 +182,13 @@ MainFrame::StylizeNodes(std::shared_ptr<Network> net) {
 
     //set Node area proportional to total represented sequences. z-height defaults to -1.
     //reset default label and such
-    for (auto &[_, n] : *net) {
+    for (Node &n : *net) {
         n.r = sqrtf(std::max(1, n.total - n.inferred));
         n.style.set_defaults();
     }
 
     //any node that consists wholly of inferred seqeunces is labeled with a ?
-    for (auto &[id, n] : *net) {
+    for (Node &n : *net) {
         if (n.total == n.inferred) n.style.label = wxString("?");
     }
 
@@ -184,7 +200,7 @@ MainFrame::StylizeNodes(std::shared_ptr<Network> net) {
         }
     }
 
-    for (auto &[_, n] : *net) {
+    for (Node &n : *net) {
         if (n.is_root()) {
             n.style.brush.SetColour(style_editor_->GetRootColor());
         } else if (n.centroid_id < 0) {
@@ -205,7 +221,7 @@ MainFrame::StylizeNodes(std::shared_ptr<Network> net) {
         }
     }
 
-    for (auto &[_, n] : *net) if (n.total == n.inferred) n.style.brush.SetColour(style_editor_->GetRootColor());
+    for (Node &n : *net) if (n.total == n.inferred) n.style.brush.SetColour(style_editor_->GetRootColor());
 
     root.style.z = 0;
 }
@@ -215,7 +231,7 @@ MainFrame::LabelTopNCentroids(std::shared_ptr<Network> net, size_t top_n) {
     if (!net) return;
 
     std::vector<size_t> priority;
-    for (auto &[id, n] : net->nodes()) if (!n.is_root()) priority.push_back(id);
+    for (const Node &n : *net) if (!n.is_root()) priority.push_back(n.id());
 
     std::sort(priority.begin(),
               priority.end(),
@@ -240,7 +256,7 @@ MainFrame::LabelAutoThresholdCentroids(std::shared_ptr<Network> net, size_t N) {
 
     //populate histogram
     size_t total = 0;
-    for (const auto &[_, n] : net->nodes()) {
+    for (const Node &n : *net) {
         if (!n.is_root()) { 
             size_t bucket = n.children().size() + n.total - 1;
             hist[bucket] += 1;
@@ -259,8 +275,8 @@ MainFrame::LabelAutoThresholdCentroids(std::shared_ptr<Network> net, size_t N) {
 
     const double X_THRESHOLD = mean + 6*std::sqrt(variance); //take 6-sigma as our centroid threshold
     std::vector<size_t> ids;
-    for (const auto &[id, n] : net->nodes()) {
-        if (n.children().size() + n.total - 1 >= X_THRESHOLD) ids.push_back(id);
+    for (const Node &n : *net) {
+        if (n.children().size() + n.total - 1 >= X_THRESHOLD) ids.push_back(n.id());
     }
     net->identify_centroids(ids);
     style_editor_->SetNumberCentroids(ids.size());
@@ -300,6 +316,8 @@ MainFrame::OnSliderScrollChanged(wxScrollEvent &evt) {
             break;
         }
     }
+
+    canvas_->WakeAnimation();
 }
 
 void
@@ -321,6 +339,7 @@ MainFrame::OnNumberCentroidsChanged(wxCommandEvent &evt) {
 
 size_t
 count_diffs(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return edit_distance(a, b);
     size_t diffs = 0;
     for (size_t i=0; i<a.size(); ++i) diffs += (a[i] != b[i]);
     return diffs;
@@ -520,7 +539,10 @@ MainFrame::OnOpen(wxCommandEvent &evt) {
         "Open dsa output file or other list of nucleotide sequences",
         "",
         "",
-        "dsa output files (*.csv)|*.csv|fasta files (*.fasta)|*.fasta|text files (*.txt)|*.txt",
+        "dsa output files (*.csv;*.csv.gz)|*.csv;*.csv.gz|"
+        "fasta files (*.fasta;*.fasta.gz)|*.fasta;*.fasta.gz|"
+        "text files (*.txt;*.txt.gz)|*.txt;*.txt.gz|"
+        "AIRR rearrangement tables (*.tsv;*.tsv.gz)|*.tsv;*.tsv.gz",
         wxFD_OPEN | wxFD_FILE_MUST_EXIST);
     if (openDialog.ShowModal() == wxID_CANCEL) return;
 
@@ -531,17 +553,50 @@ MainFrame::OnOpen(wxCommandEvent &evt) {
 
     bool run_inference = paramDialog.GetInferAncectors();
     int n_samples = paramDialog.GetNSamples();
+    bool allow_indels = paramDialog.GetAllowIndels();
 
     if (n_samples == -1) return;
 
     //parse a dsa file to get sequences and adjacency list for the consensus tree
     std::vector<std::string> sequences;
+    std::vector<size_t> counts; //how many times each sequence was read
+    std::vector<size_t> reads;  //UMI group sizes summed per sequence, dsa only
+    std::vector<std::string> dsa_aas; //dsa's translation of each sequence, dsa only
     try {
-        std::ifstream ifs(path);
-        if (!ifs) throw std::runtime_error("File " + path.string() + " could not be opened for reading.");
-        decltype(&parse_dsa) methods[] = {parse_dsa, parse_fasta, parse_text};
-        sequences = methods[openDialog.GetFilterIndex()](ifs);
-        ifs.close();
+        constexpr int AIRR_FILTER = 3;
+        SequenceCounts parsed;
+        if (openDialog.GetFilterIndex() == AIRR_FILTER) {
+            //one table holds many lineages, the user picks which to build. Once a table
+            //has been read its sidecar index lets a lineage be read without the rest
+            std::optional<CloneIndex> index = is_gzip(path) ? std::nullopt : read_clone_index(path);
+            std::vector<Lineage> lineages;
+            wxArrayString choices;
+            if (index) {
+                for (size_t i = 0; i < index->ids.size(); ++i) {
+                    choices.Add(wxString::Format("%s (%zu rows)", index->ids[i], index->rows[i]));
+                }
+            } else {
+                lineages = is_gzip(path) ? parse_airr(*open_input(path), allow_indels) : parse_airr(path, allow_indels);
+                for (const Lineage &lineage : lineages) {
+                    choices.Add(wxString::Format("%s (%zu sequences)", lineage.clone_id, lineage.sequences.seqs.size()));
+                }
+            }
+            if (choices.empty()) throw std::runtime_error("File contained no usable data.");
+            int choice = wxGetSingleChoiceIndex("Choose a clone to build", "Open Lineage", choices, 0, this);
+            if (choice == -1) return;
+            parsed = index ? parse_airr_clone(path, *index, choice, allow_indels).sequences : std::move(lineages[choice].sequences);
+        } else if (is_gzip(path)) {
+            std::unique_ptr<std::istream> ifs = open_input(path); //decompressed on the fly
+            SequenceCounts (*methods[])(std::istream &, bool) = {parse_dsa, parse_fasta, parse_text};
+            parsed = methods[openDialog.GetFilterIndex()](*ifs, allow_indels);
+        } else {
+            SequenceCounts (*methods[])(const fs::path &, bool) = {parse_dsa, parse_fasta, parse_text}; //memory mapped
+            parsed = methods[openDialog.GetFilterIndex()](path, allow_indels);
+        }
+        sequences = std::move(parsed.seqs);
+        counts = std::move(parsed.counts);
+        reads = std::move(parsed.reads);
+        dsa_aas = std::move(parsed.aas);
     } catch (std::exception &e) {
         wxString msg;
         msg << "File " << path.filename().string() << " not found or invalid format.";
@@ -557,6 +612,28 @@ MainFrame::OnOpen(wxCommandEvent &evt) {
 
     canvas_->StopAnimation();
 
+    //collapse reads that are likely PCR or sequencing errors of a more abundant
+    //read before the O(n^2) stages, their counts go to the read that absorbed them
+    if (uint32_t max_mismatches = paramDialog.GetAbsorbMismatches()) {
+        Preclusters clusters = precluster(sequences, counts, max_mismatches);
+        std::vector<std::string> centres;
+        centres.reserve(clusters.centres.size());
+        for (uint32_t i : clusters.centres) centres.push_back(std::move(sequences[i]));
+        sequences = std::move(centres);
+        counts = std::move(clusters.totals);
+        if (!reads.empty()) {
+            std::vector<size_t> absorbed(clusters.centres.size(), 0);
+            for (size_t i = 0; i < reads.size(); ++i) absorbed[clusters.members[i]] += reads[i];
+            reads = std::move(absorbed);
+        }
+        if (!dsa_aas.empty()) {
+            std::vector<std::string> kept;
+            kept.reserve(clusters.centres.size());
+            for (uint32_t i : clusters.centres) kept.push_back(std::move(dsa_aas[i]));
+            dsa_aas = std::move(kept);
+        }
+    }
+
     //ancestral inference doesn't work well with gaps so we warn the user if they checked "infer ancestors" and used an aligned input
     if (paramDialog.GetInferAncectors()) {
         for (const std::string &seq : sequences) {
@@ -572,16 +649,25 @@ MainFrame::OnOpen(wxCommandEvent &evt) {
         }
     }
 
-    std::vector<Edge> adj_list = build_consensus_mst(sequences, n_samples, paramDialog.GetInferAncectors());
+    //synonymous variants are merged by consolidate() below anyway, grouping them first
+    //leaves only one sequence per translation to the sampled trees
+    std::vector<Edge> adj_list = paramDialog.GetGroupSynonymous()
+        ? build_translation_mst(sequences, counts, n_samples, paramDialog.GetInferAncectors(), paramDialog.GetDistanceMetric())
+        : build_consensus_mst(sequences, n_samples, paramDialog.GetInferAncectors(), paramDialog.GetDistanceMetric());
     std::shared_ptr<Network> net(new Network);
 
     adj_list_ = adj_list;
     sequences_ = sequences;
 
-    Node &root = net->add_node(0); //add root
+    net->add_node(0); //add root
     for (auto [p, c, d, w] : adj_list) net->add_node(c); //make a node for each child
     for (auto [p, c, d, w] : adj_list) net->add_edge(p, c, static_cast<float>(d), w); //make an edge to each child from its parent
-    for (size_t i = 0; i < net->nodes().size(); ++i) net->node(i).nts(sequences[i]); //set the nt sequence for every node
+    net->assign_sequences(sequences); //set the nt sequence for every node
+
+    //node ids of input sequences are their indices, so read abundance becomes the node total
+    for (size_t i = 0; i < counts.size(); ++i) {
+        net->node(i).total = static_cast<int>(std::min<size_t>(counts[i], std::numeric_limits<int>::max()));
+    }
 
     //each Node gets a label that shows the amino acid mutations from the wild type/ancestor sequenc
     const std::string &ancestor = net->node(0).aas();
@@ -600,10 +686,18 @@ MainFrame::OnOpen(wxCommandEvent &evt) {
         }
 
         net->node(i).style.tooltip
+            << (i < reads.size() ? "Reads: " + std::to_string(reads[i]) + "\n" : std::string())
             << "Root Distance (nt): " << std::to_string(count_diffs(net->node(0).nts(), net->node(i).nts()))
             << "\nAncestor Distance (nt): " << std::to_string(count_diffs(net->node(i).nts(), net->node(i).parent()->nts()))
-            << "\nConfidence: " << std::to_string(net->node(i).confidence) //fraction of samples containing this edge
-            << "\nRoot Alignment:";
+            << "\nConfidence: " << std::to_string(net->node(i).confidence); //fraction of samples containing this edge
+
+        //dsa translates in the template's frame, which may differ from ours
+        if (i < dsa_aas.size() && !dsa_aas[i].empty()) {
+            net->node(i).style.tooltip << "\ndsa Translation:";
+            for (auto line : wrap(dsa_aas[i], 80)) net->node(i).style.tooltip << "\n" << std::string(line);
+        }
+
+        net->node(i).style.tooltip << "\nRoot Alignment:";
 
         std::string mismatch;
         for (size_t j=0; j < top_lines.size(); ++j) {
@@ -618,15 +712,39 @@ MainFrame::OnOpen(wxCommandEvent &evt) {
     }
 
     //merge all connected subgraphs that share the same translation
-    net->consolidate([](const Node *a, const Node *b)->bool {return a->aas() == b->aas();});
+    net->consolidate([](const Node *n) {return n->aas_id();});
 
     LabelAutoThresholdCentroids(net, 2);
 
     StylizeNodes(net);
 
+    //keep the constants the user dialed in for the previous network
+    std::shared_ptr<Network> previous = canvas_->GetNetwork();
+    if (previous) {
+        for (auto &[C, constant] : previous->constants()) net->constant(C) = constant;
+    }
+
+    //deterministic mode has to be set before the initial placement is drawn
+    net->set_deterministic(GetMenuBar()->IsChecked(ID_LAYOUT_DETERMINISTIC));
     net->init_simulation();
     net->pin_node(0);
 
+    //big lineages take thousands of steps to untangle from a random start so
+    //we start the simulation from the previous layout when re-analyzing the
+    //same lineage, otherwise from a radial or, for big trees, a multilevel layout.
+    //a different file sharing only its germline, or a few sequences, with the
+    //previous one carries too little over to be worth starting from
+    constexpr size_t MULTILEVEL_THRESHOLD = 500;
+    constexpr float MIN_CARRIED = 0.5f;
+    size_t carried = previous ? warm_start_layout(*net, *previous, MIN_CARRIED) : 0;
+    if (0 == carried) {
+        wxBusyCursor busy;
+        if (net->nodes().size() > MULTILEVEL_THRESHOLD)
+            multilevel_layout(*net);
+        else
+            radial_layout(*net);
+    }
+
     SetStatusText(path.filename().string());
     run_button_->SetLabel("Run");
     canvas_->SetNetwork(net);
@@ -640,6 +758,44 @@ MainFrame::OnEditStyle(wxCommandEvent &evt) {
     style_editor_->Bind(NUMBER_CENTROIDS_CHANGED, &MainFrame::OnNumberCentroidsChanged, this);
 }
 
+void
+MainFrame::OnLayout(wxCommandEvent &evt) {
+    std::shared_ptr<Network> net = canvas_->GetNetwork();
+    if (!net) return;
+
+    {
+        wxBusyCursor busy;
+        switch (evt.GetId()) {
+        case ID_LAYOUT_MULTILEVEL:
+            multilevel_layout(*net);
+            break;
+        case ID_LAYOUT_RADIAL:
+            radial_layout(*net);
+            break;
+        case ID_LAYOUT_STRESS:
+            stress_layout(*net);
+            break;
+        }
+    }
+
+    //radial and stress layouts are final, the physics would undo them, while a
+    //multilevel layout is a starting point for the simulation to refine
+    if (ID_LAYOUT_MULTILEVEL == evt.GetId()) {
+        canvas_->WakeAnimation();
+    } else {
+        canvas_->StopAnimation();
+        run_button_->SetValue(false);
+        run_button_->SetLabel("Run");
+    }
+    canvas_->Refresh();
+}
+
+void
+MainFrame::OnDeterministic(wxCommandEvent &evt) {
+    std::shared_ptr<Network> net = canvas_->GetNetwork();
+    if (net) net->set_deterministic(evt.IsChecked());
+}
+
 void
 MainFrame::OnExportGraphic(wxCommandEvent &evt) {
     wxFileDialog saveFileDialog(
@@ -735,7 +891,7 @@ MainFrame::OnExportTable(wxCommandEvent &evt) {
     if (path.empty()) return;
 
     std::vector<Node *> centroids;
-    for (auto &[_, n] : *(canvas_->GetNetwork())) {
+    for (Node &n : *(canvas_->GetNetwork())) {
         if (n.centroid_id != Node::NA) centroids.push_back(&n);
     }
     std::sort(centroids.begin(), centroids.end(),
@@ -791,7 +947,7 @@ MainFrame::OnExportSequences(wxCommandEvent &evt) {
     if (path.empty()) return;
 
     std::vector<Node *> centroids;
-    for (auto &[_, n] : *(canvas_->GetNetwork())) {
+    for (Node &n : *(canvas_->GetNetwork())) {
         if (n.centroid_id != Node::NA) centroids.push_back(&n);
     }
     std::sort(centroids.begin(), centroids.end(),
@@ -846,13 +1002,13 @@ MainFrame::OnExportAdjacency(wxCommandEvent &evt) {
         errorDialog.ShowModal();
     }
 
-    for (const auto &[id, n] : *net) {
+    for (const Node &n : *net) {
         if (0 == n.id()) continue;
         ofs << "(" << n.parent()->id() << ", " << n.id() << "; " << n.confidence << ")\n";
     }
     ofs << "//\n";
-    for (const auto &[id, n] : *net) {
-        ofs << ">" << id << "\n";
+    for (const Node &n : *net) {
+        ofs << ">" << n.id() << "\n";
         ofs << n.aas() << "\n";
     }
 
@@ -891,6 +1047,14 @@ RunParametersDialog::RunParametersDialog(wxWindow *parent, wxWindowID id, const
     inferCheckBox_ = new wxCheckBox(this, wxID_ANY, "");
     inferCheckBox_->SetValue(false);
     samplesSpinCtrl_ = new wxSpinCtrl(this, wxID_ANY, "1", wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 1, 1001, 1);
+    absorbSpinCtrl_ = new wxSpinCtrl(this, wxID_ANY, "0", wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 10, 0);
+    indelsCheckBox_ = new wxCheckBox(this, wxID_ANY, "");
+    indelsCheckBox_->SetValue(false);
+    wxString distances[] = {"Nucleotide", "Amino Acid", "BLOSUM62"};
+    distanceChoice_ = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, 3, distances);
+    distanceChoice_->SetSelection(DISTANCE_NUCLEOTIDE);
+    synonymousCheckBox_ = new wxCheckBox(this, wxID_ANY, "");
+    synonymousCheckBox_->SetValue(false);
 
     wxBoxSizer *vbox = new wxBoxSizer(wxVERTICAL);
 
@@ -899,6 +1063,14 @@ RunParametersDialog::RunParametersDialog(wxWindow *parent, wxWindowID id, const
     grid->Add(inferCheckBox_, 0, wxALL, 5);
     grid->Add(new wxStaticText(this, wxID_ANY, "Sample Size [1..1001]"), 0, wxALL, 5);
     grid->Add(samplesSpinCtrl_, 0, wxALL, 5);
+    grid->Add(new wxStaticText(this, wxID_ANY, "Absorb Mismatches [0..10]"), 0, wxALL, 5);
+    grid->Add(absorbSpinCtrl_, 0, wxALL, 5);
+    grid->Add(new wxStaticText(this, wxID_ANY, "Allow Indels"), 0, wxALL, 5);
+    grid->Add(indelsCheckBox_, 0, wxALL, 5);
+    grid->Add(new wxStaticText(this, wxID_ANY, "Distance"), 0, wxALL, 5);
+    grid->Add(distanceChoice_, 0, wxALL, 5);
+    grid->Add(new wxStaticText(this, wxID_ANY, "Group Synonymous"), 0, wxALL, 5);
+    grid->Add(synonymousCheckBox_, 0, wxALL, 5);
 
     vbox->Add(grid, 0, wxEXPAND, 5);
     vbox->AddStretchSpacer();
@@ -920,3 +1092,28 @@ int
 RunParametersDialog::GetNSamples() const {
     return samplesSpinCtrl_->GetValue();
 }
+
+int
+RunParametersDialog::GetAbsorbMismatches() const {
+    return absorbSpinCtrl_->GetValue();
+}
+
+bool
+RunParametersDialog::GetAllowIndels() const {
+    return indelsCheckBox_->GetValue();
+}
+
+DistanceMetric
+RunParametersDialog::GetDistanceMetric() const {
+    //sequences of different lengths are only kept with indels allowed, edit distances relate them
+    switch (distanceChoice_->GetSelection()) {
+    case DISTANCE_AMINO_ACID: return DistanceMetric::AMINO_ACID;
+    case DISTANCE_BLOSUM62:   return DistanceMetric::BLOSUM62;
+    default:                  return GetAllowIndels() ? DistanceMetric::EDIT : DistanceMetric::HAMMING;
+    }
+}
+
+bool
+RunParametersDialog::GetGroupSynonymous() const {
+    return synonymousCheckBox_->GetValue();
+}
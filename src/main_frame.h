@@ -67,6 +67,10 @@ private:
         ID_EXPORT_ADJACENCY,
         ID_EXPORT_MARKOV,
         ID_EDIT_STYLE,
+        ID_LAYOUT_MULTILEVEL,
+        ID_LAYOUT_RADIAL,
+        ID_LAYOUT_STRESS,
+        ID_LAYOUT_DETERMINISTIC,
         ID_HELP_CONSOLE
     };
 
@@ -92,6 +96,14 @@ private:
     /** Open the style editor. */
     void OnEditStyle(wxCommandEvent &evt);
 
+    /** Re-layout the Network with the layout engine chosen from the Layout menu. */
+    void OnLayout(wxCommandEvent &evt);
+
+    /** Switch the simulation of the current and later Networks in and out of
+    * reproducible mode, see Network::set_deterministic().
+    */
+    void OnDeterministic(wxCommandEvent &evt);
+
     /** Export our Network drawing as SVG of .png */
     void OnExportGraphic(wxCommandEvent &evt);
 
@@ -128,6 +140,14 @@ private:
 * will be performed for each sample of the MST forest<br/>
 * Samples: the number of MSTs created from randomly permuted data used to form
 * the consensus tree.<br/>
+* Absorb Mismatches: sequences within this many mismatches of a more abundant
+* one are merged into it before tree construction, 0 to keep every sequence.<br/>
+* Allow Indels: keep sequences whose length differs from the ancestor's and
+* measure nucleotide distances in edits rather than mismatches.<br/>
+* Distance: compare nucleotides, or the translations by amino acid mismatches
+* or BLOSUM62 weighted substitutions so synonymous mutations don't split nodes.<br/>
+* Group Synonymous: sample trees over one sequence per translation only and
+* attach the synonymous variants of each afterwards, for large lineages.<br/>
 * Label Method: Top N will classify the N "largest" nodes as centroids (where
 * node size is #non-coding variants + # of direct ancestors). Auto Threshold
 * fits and exponential distribution (i.e., y = lambda * e^-(lambda*x)) to the
@@ -145,8 +165,18 @@ public:
         LABEL_METHOD_AUTO  = 1
     };
 
+    enum Distance {
+        DISTANCE_NUCLEOTIDE = 0,
+        DISTANCE_AMINO_ACID = 1,
+        DISTANCE_BLOSUM62   = 2
+    };
+
     bool GetInferAncectors() const;
     int GetNSamples() const;
+    int GetAbsorbMismatches() const;
+    bool GetAllowIndels() const;
+    DistanceMetric GetDistanceMetric() const;
+    bool GetGroupSynonymous() const;
 
 private:
     const int DEFAULT_TOP_N = 10;
@@ -154,6 +184,10 @@ private:
 
     wxCheckBox *inferCheckBox_     = nullptr;
     wxSpinCtrl *samplesSpinCtrl_         = nullptr;
+    wxSpinCtrl *absorbSpinCtrl_          = nullptr;
+    wxCheckBox *indelsCheckBox_    = nullptr;
+    wxChoice *distanceChoice_      = nullptr;
+    wxCheckBox *synonymousCheckBox_ = nullptr;
 };
 
 #endif
\ No newline at end of file
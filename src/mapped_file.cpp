@@ -0,0 +1,106 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+    HANDLE file = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("File " + path.string() + " could not be opened for reading.");
+    file_ = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error("Size of file " + path.string() + " could not be determined.");
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0) return; //empty files can't be mapped
+
+    mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_) data_ = static_cast<const char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (!data_) {
+        if (mapping_) CloseHandle(mapping_);
+        CloseHandle(file);
+        throw std::runtime_error("File " + path.string() + " could not be mapped into memory.");
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0)
+        throw std::runtime_error("File " + path.string() + " could not be opened for reading.");
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        close(fd_);
+        throw std::runtime_error("Size of file " + path.string() + " could not be determined.");
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ == 0) return; //empty files can't be mapped
+
+    void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (p == MAP_FAILED) {
+        close(fd_);
+        throw std::runtime_error("File " + path.string() + " could not be mapped into memory.");
+    }
+    madvise(p, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(p);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) munmap(const_cast<char *>(data_), size_);
+    close(fd_);
+}
+
+#endif
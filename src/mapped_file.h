@@ -0,0 +1,58 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CCB_MAPPED_FILE_H_
+#define CCB_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+/** A read-only memory mapping of a whole file. The contents are paged in by
+* the OS as they are touched and never copied onto the heap.
+*/
+struct MappedFile {
+    /** Map the file at path, throws std::runtime_error if it can't be opened or mapped. */
+    explicit MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /** Get the contents of the file. Views stay valid as long as the MappedFile. */
+    std::string_view view() const { return std::string_view(data_, size_); }
+
+    size_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    #ifdef _WIN32
+    void *file_ = nullptr;    //HANDLE
+    void *mapping_ = nullptr; //HANDLE
+    #else
+    int fd_ = -1;
+    #endif
+};
+
+#endif
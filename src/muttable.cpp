@@ -71,10 +71,13 @@ MutTable::MutTable(const std::vector<std::string> &seqs) {
 
     const std::string &anc = seqs[0];
     ancestor_ = anc;
+
+    //sequences with indels can be shorter than the ancestor, missing positions read as gaps
+    auto at = [](const std::string &seq, size_t i) { return i < seq.size() ? seq[i] : '-'; };
+
     for (size_t i=0; i<anc.size(); ++i) {
         for (size_t j=1; j<seqs.size(); ++j) {
-            assert (seqs[j].size() == anc.size());
-            if (anc[i] != seqs[j][i]) {
+            if (anc[i] != at(seqs[j], i)) {
                 loc_.push_back(i);
                 break;
             }
@@ -87,7 +90,7 @@ MutTable::MutTable(const std::vector<std::string> &seqs) {
         size_t p=loc_[i];
         res_[0][i] = anc[p];
         for (size_t j=1; j<seqs.size(); ++j) {
-            if (anc[p] != seqs[j][p]) res_[j][i] = seqs[j][p]; 
+            if (anc[p] != at(seqs[j], p)) res_[j][i] = at(seqs[j], p);
         }
     }
 }
@@ -21,11 +21,13 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <iostream>
 #include <limits>
 #include <numbers>
+#include <random>
 #include <thread>
 
 #include "network.h"
@@ -37,82 +39,134 @@ const int Node::NA = -1;
 size_t
 Node::nts(std::string_view seq) {
     size_t filtered = 0;
-    std::tie(nts_, filtered) = make_valid_dna(seq);
-    aas_ = translate(nts_);
+    nts_id_ = net_->intern_nts(seq, filtered);
+    aas_id_ = net_->translation(nts_id_);
     return filtered;
 }
 
 void
 Node::add_child(Node *c) {
-    c->parent_ = this;
-    children_.insert(c);
+    net_->parents_[c->index_] = index_;
+    net_->children_dirty_ = true;
 }
 
 void
 Node::remove_child(Node *c) {
-    c->parent_ = nullptr;
-    children_.erase(c);    
+    if (net_->parents_[c->index_] != index_) return;
+    net_->parents_[c->index_] = Network::NONE;
+    net_->children_dirty_ = true;
 }
 
-void
-Node::merge_child(Node *c) {
-    assert(this == c->parent_);
+Network::Network() {
+    params_['G'] = Constant(-0.1f,   0.0f, -1.0f);
+    params_['C'] = Constant(0.001f,  0.0f, 0.01f);
+    params_['B'] = Constant(1.0f,    0.0f, 2.0f);
+    params_['K'] = Constant(0.25f,   0.0f, 2.0f);
+    params_['E'] = Constant(1.0f,    0.5f, 2.0f);
+    params_['V'] = Constant(0.2f,   10.0f, 0.1f);
+    params_['T'] = Constant(1.0f,    0.1f, 4.0f);
+}
 
-    children_.erase(c);
+Node &
+Network::add_node(size_t id) {
+    if (contains(id)) throw std::runtime_error("Network already contains Node with id=" + std::to_string(id));
+    if (id >= id_index_.size()) id_index_.resize(id + 1, NONE);
 
-    for (Node *gc : c->children_) {
-        gc->parent_ = this;
-        children_.insert(gc);
+    //ids usually arrive in order, anything else shifts the Nodes after it
+    const uint32_t at = static_cast<uint32_t>(
+        std::lower_bound(nodes_.begin(), nodes_.end(), id, [](const Node &n, size_t i) { return n.id_ < i; }) - nodes_.begin()
+    );
+    nodes_.insert(nodes_.begin() + at, Node(this, id, at));
+    parents_.insert(parents_.begin() + at, NONE);
+    if (at + 1 != nodes_.size()) {
+        for (uint32_t &p : parents_) if (p != NONE && p >= at) ++p;
+        for (uint32_t i = at + 1; i < nodes_.size(); ++i) {
+            nodes_[i].index_ = i;
+            id_index_[nodes_[i].id_] = i;
+        }
     }
+    id_index_[id] = at;
+    children_dirty_ = true;
 
-    c->parent_ = nullptr;
-    c->children_.clear();
+    clear_simulation();
 
-    total += c->total;
-    inferred += c->inferred;
+    return nodes_[at];
+}
+
+uint32_t
+Network::index_of(size_t id) const {
+    if (!contains(id)) throw std::out_of_range("Network has no Node with id=" + std::to_string(id));
+    return id_index_[id];
 }
 
 void
-Node::merge_sibling(Node *s) {
-    assert(s->parent_ == parent_);
+Network::update_children() const {
+    if (!children_dirty_) return;
+
+    //counting sort by parent, children come out in id order
+    child_start_.assign(nodes_.size() + 1, 0);
+    for (uint32_t p : parents_) if (p != NONE) ++child_start_[p + 1];
+    for (size_t i = 1; i < child_start_.size(); ++i) child_start_[i] += child_start_[i - 1];
+
+    std::vector<uint32_t> next(child_start_.begin(), child_start_.end() - 1);
+    child_ptrs_.resize(child_start_.back());
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        const uint32_t p = parents_[i];
+        if (p != NONE) child_ptrs_[next[p]++] = const_cast<Node *>(&nodes_[i]);
+    }
 
-    parent_->children_.erase(s);
+    children_dirty_ = false;
+}
 
-    for (Node *c : s->children_) {
-        c->parent_ = this;
-        children_.insert(c);
+void
+Network::compact(const std::vector<uint8_t> &keep) {
+    std::vector<uint32_t> moved(nodes_.size(), NONE);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < nodes_.size(); ++i) {
+        if (!keep[i]) {
+            id_index_[nodes_[i].id_] = NONE;
+            continue;
+        }
+        moved[i] = n;
+        if (n != i) {
+            nodes_[n] = std::move(nodes_[i]);
+            parents_[n] = parents_[i];
+        }
+        nodes_[n].index_ = n;
+        id_index_[nodes_[n].id_] = n;
+        ++n;
     }
 
-    s->parent_ = nullptr;
-    s->children_.clear();
+    std::vector<Node *> centroids;
+    for (Node *c : centroids_) {
+        const uint32_t i = moved[c->index_];
+        if (i != NONE) centroids.push_back(&nodes_[i]);
+    }
 
-    total += s->total;
-    inferred += s->inferred;
-}
+    nodes_.erase(nodes_.begin() + n, nodes_.end());
+    parents_.resize(n);
+    for (uint32_t &p : parents_) if (p != NONE) p = moved[p];
 
-Network::Network() {
-    params_['G'] = Constant(-0.1f,   0.0f, -1.0f);
-    params_['C'] = Constant(0.001f,  0.0f, 0.01f);
-    params_['B'] = Constant(1.0f,    0.0f, 2.0f);
-    params_['K'] = Constant(0.25f,   0.0f, 2.0f);
-    params_['E'] = Constant(1.0f,    0.5f, 2.0f);
-    params_['V'] = Constant(0.2f,   10.0f, 0.1f);
-    params_['T'] = Constant(1.0f,    0.1f, 4.0f);
+    centroids_ = std::move(centroids);
+    children_dirty_ = true;
+
+    clear_simulation();
 }
 
-Node &
-Network::add_node(size_t id) {
-    auto [ii, ins] = nodes_.insert({id, Node(id)});
-    if (!ins) throw std::runtime_error("Network already contains Node with id=" + std::to_string(id));
-    return ii->second;
+void
+Network::merge_counts(uint32_t a, uint32_t b) {
+    parents_[b] = NONE;
+    nodes_[a].total += nodes_[b].total;
+    nodes_[a].inferred += nodes_[b].inferred;
 }
 
 void
 Network::add_edge(size_t p, size_t c, float weight, float confidence) {
     try {
-        nodes_.at(p).add_child(&nodes_.at(c));
-        nodes_.at(c).length = weight;
-        nodes_.at(c).confidence = confidence;
+        Node &child = node(c);
+        node(p).add_child(&child);
+        child.length = weight;
+        child.confidence = confidence;
     } catch (std::out_of_range &ex) {
         (void)ex;
         throw std::out_of_range("Network missing either Node " + 
@@ -133,69 +187,68 @@ Network::label_centroids() {
 void
 Network::identify_centroids(const std::vector<size_t> &centroid_ids) {
     clear_centroids();
-    for (size_t id : centroid_ids) if (!nodes_.at(id).is_root()) centroids_.push_back(&nodes_.at(id));
+    for (size_t id : centroid_ids) if (!node(id).is_root()) centroids_.push_back(&node(id));
     label_centroids();
 }
 
 void
 Network::clear_centroids() {
     centroids_.clear();
-    for (auto &[_, n] : nodes_) n.centroid_id = Node::NA;
+    for (Node &n : nodes_) n.centroid_id = Node::NA;
 }
 
 void
 Network::init_simulation() {
     iteration_ = 0;
     max_velocity_ = 0.0f;
+    kinetic_energy_ = 0.0f;
+    max_displacement_ = 0.0f;
 
     ptrs_.clear();
-    for (auto &[id, node] : nodes_) ptrs_.push_back(&node);
+    for (Node &node : nodes_) ptrs_.push_back(&node);
     std::sort(
         ptrs_.begin(),
         ptrs_.end(), 
         [](Node *a, Node *b)->bool{return a->style.z < b->style.z;}
     );
 
+    sim_index_.assign(nodes_.size(), NONE);
+    for (size_t i = 0; i < ptrs_.size(); ++i) sim_index_[ptrs_[i]->index_] = static_cast<uint32_t>(i);
+
     pins_.clear();
     pins_.resize(ptrs_.size(), 1);
 
+    //mt19937 output is fixed by the standard, unlike rand() or the std distributions
+    std::mt19937 rng(seed_);
+    auto random_fraction = [&]()->float {
+        if (deterministic_) return (rng() >> 8) / 16777216.0f;
+        return rand() / static_cast<float>(RAND_MAX);
+    };
+
     x_.clear();
     x_.resize(ptrs_.size());
-    for (float &x : x_) x = std::cos(rand() / static_cast<float>(RAND_MAX) * 2 * pi);
+    for (float &x : x_) x = std::cos(random_fraction() * 2 * pi);
 
     y_.clear();
     y_.resize(ptrs_.size());
-    for (float &y : y_) y = std::sin(rand() / static_cast<float>(RAND_MAX) * 2 * pi);
+    for (float &y : y_) y = std::sin(random_fraction() * 2 * pi);
 
     m_.clear();
     for (Node *n : ptrs_) {
-        float mass = n->mass + n->children_.size();
+        float mass = n->mass + n->children().size();
         m_.push_back(mass);
     }
 
-    //l and k are lower triangular without diagonal
-    //0-based row and col indices i, j can be obtained
-    //from linear index k by ltri_ij(k) function
-    l_.clear();
-    s_.clear();
-
-    for (size_t i = 1; i < ptrs_.size(); ++i) {
-        for (size_t j = 0; j != i; ++j) {
-            if (ptrs_[i]->parent() == ptrs_[j]) {
-                auto [mi, mj] = ltri_ij(l_.size());
-                assert (mi == i && mj == j);
-                l_.push_back(ptrs_[i]->length + ptrs_[i]->r + ptrs_[j]->r);
-                s_.push_back(1.0f);
-            } else if (ptrs_[j]->parent() == ptrs_[i]) {
-                auto [mi, mj] = ltri_ij(l_.size());
-                assert(mi == i && mj == j);
-                l_.push_back(ptrs_[j]->length + ptrs_[i]->r + ptrs_[j]->r);
-                s_.push_back(1.0f);
-            } else {
-                l_.push_back(0.0f);
-                s_.push_back(0.0f);
-            }
-        }
+    //one spring per tree edge
+    spring_a_.clear();
+    spring_b_.clear();
+    spring_l_.clear();
+    for (size_t i = 0; i < ptrs_.size(); ++i) {
+        const Node *p = ptrs_[i]->parent();
+        if (!p) continue;
+        spring_a_.push_back(static_cast<uint32_t>(i));
+        spring_b_.push_back(sim_index_[p->index_]);
+        spring_l_.push_back(ptrs_[i]->length + ptrs_[i]->r + p->r);
     }
 
     vx_.clear();
@@ -204,46 +257,161 @@ Network::init_simulation() {
     vy_.clear();
     vy_.resize(ptrs_.size(), 0.0f);
 
-    d_vx_.clear();
-    d_vx_.resize(ptrs_.size(), 0.0f);
-
-    d_vy_.clear();
-    d_vy_.resize(ptrs_.size(), 0.0f);
-
     for (size_t i = 0; i < ptrs_.size(); ++i) {
         Node &n = *ptrs_[i];
         n.pos.x = x_[i];
         n.pos.y = y_[i];
     }
 
-    n_workers_ = std::max(2U, std::thread::hardware_concurrency()) - 1;
+    rad_.clear();
+    for (Node *n : ptrs_) rad_.push_back(static_cast<float>(n->r));
+    double r_sum = 0.0;
+    for (float r : rad_) r_sum += r;
+    min_cell_ = rad_.empty() ? 0.0f : static_cast<float>(2.0 * r_sum / rad_.size());
+    cells_.clear();
+    cells_.resize(ptrs_.size());
+
+    awake_.clear();
+    awake_.resize(ptrs_.size(), 1);
+    moving_.clear();
+    moving_.resize(ptrs_.size(), 1);
+    calm_.clear();
+    calm_.resize(ptrs_.size(), 0);
+    settling_.clear();
+    constants_seen_ = constant_values();
+
+    allocate_chunks();
+    update_bounds();
+    grid_dirty_ = true;
+}
+
+void
+Network::clear_simulation() {
+    //the simulation refers to Nodes by pointer and index
+    ptrs_.clear();
+    sim_index_.clear();
+    pins_.clear();
+    x_.clear();
+    y_.clear();
+    m_.clear();
+    rad_.clear();
+    spring_a_.clear();
+    spring_b_.clear();
+    spring_l_.clear();
+    vx_.clear();
+    vy_.clear();
+    awake_.clear();
+    moving_.clear();
+    calm_.clear();
+    settling_.clear();
+    cells_.clear();
+    bounds_ = BBox();
+    grid_dirty_ = true;
+}
+
+void
+Network::allocate_chunks() {
+    //in deterministic mode the work is cut into a fixed number of chunks so
+    //the partial sums do not depend on how many threads there are
+    constexpr size_t DETERMINISTIC_CHUNKS = 64;
+
+    n_workers_ = workers_ ? workers_ : std::max(2U, std::thread::hardware_concurrency()) - 1;
+    const size_t n_chunks = deterministic_ ? DETERMINISTIC_CHUNKS : n_workers_;
+
     fxs_.clear();
-    fxs_.resize(n_workers_, std::vector<float>(ptrs_.size(), 0.0f));
+    fxs_.resize(n_chunks, std::vector<float>(ptrs_.size(), 0.0f));
     fys_.clear();
-    fys_.resize(n_workers_, std::vector<float>(ptrs_.size(), 0.0f));
+    fys_.resize(n_chunks, std::vector<float>(ptrs_.size(), 0.0f));
+    wakes_.clear();
+    wakes_.resize(n_chunks, std::vector<uint8_t>(ptrs_.size(), 0));
+}
+
+void
+Network::set_deterministic(bool deterministic, uint32_t seed) {
+    deterministic_ = deterministic;
+    seed_ = seed;
+    allocate_chunks();
+}
+
+void
+Network::set_workers(size_t workers) {
+    workers_ = workers;
+    allocate_chunks();
+}
+
+std::array<float, 7>
+Network::constant_values() const {
+    return {
+        params_.at('B').value(),
+        params_.at('C').value(),
+        params_.at('E').value(),
+        params_.at('G').value(),
+        params_.at('K').value(),
+        params_.at('V').value(),
+        params_.at('T').value()
+    };
+}
+
+void
+Network::update_bounds() {
+    bounds_ = BBox();
+    for (size_t i = 0; i < ptrs_.size(); ++i) bounds_.expand(x_[i], y_[i], rad_[i]);
+}
+
+void
+Network::load_positions() {
+    for (size_t i = 0; i < ptrs_.size(); ++i) {
+        x_[i] = ptrs_[i]->pos.x;
+        y_[i] = ptrs_[i]->pos.y;
+    }
+    std::fill(vx_.begin(), vx_.end(), 0.0f);
+    std::fill(vy_.begin(), vy_.end(), 0.0f);
+    max_velocity_ = 0.0f;
+    kinetic_energy_ = 0.0f;
+    max_displacement_ = 0.0f;
+    wake_all();
+    settling_.clear();
+    update_bounds();
+    grid_dirty_ = true;
+}
+
+void
+Network::load_positions(const std::unordered_set<const Node *> &settled) {
+    load_positions();
+    if (0 == sleep_steps_) return;
+
+    //everyone stays awake for one step so the forces between settled nodes are
+    //complete, which catches springs stretched by a changed tree
+    settling_.resize(ptrs_.size(), 0);
+    for (size_t i = 0; i < ptrs_.size(); ++i) settling_[i] = settled.contains(ptrs_[i]);
 }
 
 void
 simulate_step_worker(
     std::vector<float> &fx_out,
     std::vector<float> &fy_out,
-    size_t lo,
-    size_t hi,
+    std::vector<uint8_t> &wake_out,
+    std::span<const uint32_t> rows,
+    const std::vector<uint32_t> &asleep,
+    const std::vector<uint8_t> &awake,
+    const std::vector<uint8_t> &moving,
     const std::vector<float> &x,
     const std::vector<float> &y,
-    const std::vector<float> &s,
-    const std::vector<float> &L,
     const std::vector<float> &m,
-    float E,
+    const std::vector<float> &rad,
     float G,
-    float K,
     float EPSILON) {
 
+    //a moving node wakes sleeping nodes that lie within this many combined
+    //radii of it, springs wake the nodes they tie together separately
+    constexpr float WAKE_REACH = 4.0f;
+
     std::fill(fx_out.begin(), fx_out.end(), 0.0f);
     std::fill(fy_out.begin(), fy_out.end(), 0.0f);
+    std::fill(wake_out.begin(), wake_out.end(), 0);
 
-    auto [i, j] = ltri_ij(lo);
-    for (size_t li=lo; li != hi; ++li) {
+    //gravity on i from j, returns distance between them
+    auto pair = [&](size_t i, size_t j, float &fx, float &fy)->float {
         const float dx = x[j] - x[i];
         const float dy = y[j] - y[i];
         float r_sq = dx * dx + dy * dy;
@@ -255,28 +423,59 @@ simulate_step_worker(
         float fg = G * m[i] * m[j];
         fg /= r_sq;
 
-        float k = K * s[li];
-        float l = E * L[li];
-
-        float fs = r - l;
-        fs *= k;
-
-        float fx = fg + fs;
-        fx *= dx;
-        fx /= r;
+        fx = fg * dx / r;
+        fy = fg * dy / r;
+
+        return r;
+    };
+
+    //awake node a interacts with every node below it; pairs with sleeping
+    //nodes above it are picked up from the asleep list, pairs with awake
+    //nodes above it belong to that node's row
+    for (uint32_t a : rows) {
+        for (size_t j = 0; j < a; ++j) {
+            float fx, fy;
+            const float r = pair(a, j, fx, fy);
+            fx_out[a] += fx;
+            fy_out[a] += fy;
+            fx_out[j] -= fx;
+            fy_out[j] -= fy;
+            if (moving[a] && !awake[j] && r < WAKE_REACH * (rad[a] + rad[j])) wake_out[j] = 1;
+        }
 
-        float fy = fg + fs;
-        fy *= dy;
-        fy /= r;
+        for (auto ji = std::upper_bound(asleep.begin(), asleep.end(), a); ji != asleep.end(); ++ji) {
+            float fx, fy;
+            const size_t j = *ji;
+            const float r = pair(a, j, fx, fy);
+            fx_out[a] += fx;
+            fy_out[a] += fy;
+            if (moving[a] && r < WAKE_REACH * (rad[a] + rad[j])) wake_out[j] = 1;
+        }
+    }
+}
 
-        fx_out[i] += fx;
-        fy_out[i] += fy;
-        fx_out[j] -= fx;
-        fy_out[j] -= fy;
-  
-        if (++j == i) {
-            ++i;
-            j = 0;
+void
+reduce_chunks_worker(
+    std::vector<std::vector<float>> &fxs,
+    std::vector<std::vector<float>> &fys,
+    std::vector<std::vector<uint8_t>> &wakes,
+    size_t lo,
+    size_t hi) {
+
+    //pairwise tree: chunk c absorbs chunk c + stride, the total ends up in chunk 0
+    for (size_t stride = 1; stride < fxs.size(); stride *= 2) {
+        for (size_t c = 0; c + stride < fxs.size(); c += 2 * stride) {
+            std::vector<float> &fx = fxs[c];
+            std::vector<float> &fy = fys[c];
+            std::vector<uint8_t> &wake = wakes[c];
+            const std::vector<float> &fx_in = fxs[c + stride];
+            const std::vector<float> &fy_in = fys[c + stride];
+            const std::vector<uint8_t> &wake_in = wakes[c + stride];
+            for (size_t i = lo; i < hi; ++i) {
+                fx[i] += fx_in[i];
+                fy[i] += fy_in[i];
+                wake[i] |= wake_in[i];
+            }
         }
     }
 }
@@ -291,146 +490,397 @@ Network::simulate_step() {
     const float Vmax = params_['V'].value();
     const float dT   = params_['T'].value();
 
-    std::fill(d_vx_.begin(), d_vx_.end(), 0.0f);
-    std::fill(d_vy_.begin(), d_vy_.end(), 0.0f);
+    //any change to the constants moves the equilibrium of every node
+    const std::array<float, 7> seen = constant_values();
+    if (seen != constants_seen_) {
+        constants_seen_ = seen;
+        wake_all();
+    }
+
+    active_.clear();
+    asleep_.clear();
+    for (uint32_t i = 0; i < ptrs_.size(); ++i) {
+        if (awake_[i]) active_.push_back(i);
+        else asleep_.push_back(i);
+    }
+
+    if (active_.empty()) {
+        max_velocity_ = 0.0f;
+        kinetic_energy_ = 0.0f;
+        max_displacement_ = 0.0f;
+        return ++iteration_;
+    }
+
+    //awake row a costs a pairs plus one for every sleeping node above it,
+    //split the awake rows into runs of roughly equal cost
+    const size_t n_chunks = fxs_.size();
+    std::vector<size_t> bounds(n_chunks + 1, active_.size());
+    bounds[0] = 0;
+    {
+        std::vector<size_t> cost(active_.size());
+        size_t above = asleep_.size();
+        size_t total = 0;
+        for (size_t k = 0, ai = 0; k < active_.size(); ++k) {
+            while (ai < asleep_.size() && asleep_[ai] < active_[k]) {
+                ++ai;
+                --above;
+            }
+            total += active_[k] + above;
+            cost[k] = total;
+        }
+        for (size_t c = 1; c < n_chunks; ++c) {
+            const size_t target = total / n_chunks * c;
+            bounds[c] = std::lower_bound(cost.begin(), cost.end(), target) - cost.begin();
+        }
+    }
 
+    //every chunk sums into its own buffers so the result does not depend
+    //on which thread handled it
     std::vector<std::thread> threads;
+    const std::span<const uint32_t> rows(active_);
+    for (size_t t = 0; t < n_workers_; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            for (size_t c = t; c < n_chunks; c += n_workers_) {
+                simulate_step_worker(
+                    fxs_[c],
+                    fys_[c],
+                    wakes_[c],
+                    rows.subspan(bounds[c], bounds[c + 1] - bounds[c]),
+                    asleep_,
+                    awake_,
+                    moving_,
+                    x_,
+                    y_,
+                    m_,
+                    rad_,
+                    G,
+                    EPSILON_
+                );
+            }
+        }));
+    }
+    for (std::thread &t : threads) t.join();
 
-    size_t chunk = (ptrs_.size() * (ptrs_.size() - 1)) / 2 / n_workers_;
-    for (size_t i=0; i<n_workers_; ++i) {
+    threads.clear();
+    const size_t span = (ptrs_.size() + n_workers_ - 1) / n_workers_;
+    for (size_t t = 0; t < n_workers_; ++t) {
         threads.push_back(
             std::thread(
-                simulate_step_worker,
-                std::ref(fxs_[i]),
-                std::ref(fys_[i]),
-                i * chunk,
-                (i == ptrs_.size() - 1) ? ptrs_.size() : (i + 1) * chunk,
-                std::cref(x_),
-                std::cref(y_),
-                std::cref(s_),
-                std::cref(l_),
-                std::cref(m_),
-                E,
-                G,
-                K,
-                EPSILON_
+                reduce_chunks_worker,
+                std::ref(fxs_),
+                std::ref(fys_),
+                std::ref(wakes_),
+                std::min(ptrs_.size(), t * span),
+                std::min(ptrs_.size(), (t + 1) * span)
             )
         );
     }
+    for (std::thread &t : threads) t.join();
 
-    threads[0].join();
     std::vector<float> &fx = fxs_[0];
     std::vector<float> &fy = fys_[0];
+    std::vector<uint8_t> &wake = wakes_[0];
+
+    //springs along the tree edges, in a fixed order
+    for (size_t e = 0; e < spring_a_.size(); ++e) {
+        const uint32_t i = spring_a_[e];
+        const uint32_t j = spring_b_[e];
+        if (!awake_[i] && !awake_[j]) continue;
+
+        const float dx = x_[j] - x_[i];
+        const float dy = y_[j] - y_[i];
+        const float r = std::max(std::sqrt(dx * dx + dy * dy), EPSILON_);
+        const float fs = K * (r - E * spring_l_[e]);
+        const float sx = fs * dx / r;
+        const float sy = fs * dy / r;
+        fx[i] += sx;
+        fy[i] += sy;
+        fx[j] -= sx;
+        fy[j] -= sy;
+
+        if (awake_[i] && moving_[i] && !awake_[j]) wake[j] = 1;
+        if (awake_[j] && moving_[j] && !awake_[i]) wake[i] = 1;
+    }
 
-    for (size_t i=1; i<threads.size(); ++i) {
-        threads[i].join();
-        for (size_t j=0; j<fx.size(); ++j) {
-            fx[j] += fxs_[i][j];
-            fy[j] += fys_[i][j];
+    //a single pass integrates, writes positions back and gathers the step
+    //statistics and the bounding box.
+    //forces on sleeping nodes are incomplete, they stay where they are.
+    //the grid is shaped to the last step's bounds and filled as nodes move,
+    //nodes that moved outside them are binned in the border cells
+    grid_.reshape(bounds_.lo.x, bounds_.lo.y, bounds_.hi.x, bounds_.hi.y, ptrs_.size(), min_cell_);
+
+    double energy = 0.0;
+    float v_max = 0.0f;
+    bounds_ = BBox();
+    const bool settling = !settling_.empty();
+    for (size_t i = 0; i < ptrs_.size(); ++i) {
+        if (!awake_[i]) {
+            if (wake[i]) {
+                awake_[i] = 1;
+                calm_[i] = 0;
+            }
+            bounds_.expand(x_[i], y_[i], rad_[i]);
+            cells_[i] = grid_.cells(x_[i], y_[i], rad_[i]);
+            continue;
         }
-    }
 
-    for (size_t i = 0; i < fx.size(); ++i) {
-        d_vx_[i] = (fx[i] - B * vx_[i] - C * x_[i]) / m_[i];
-    }
+        float vx = vx_[i] + (fx[i] - B * vx_[i] - C * x_[i]) / m_[i];
+        float vy = vy_[i] + (fy[i] - B * vy_[i] - C * y_[i]) / m_[i];
 
-    for (size_t i = 0; i < fy.size(); ++i) {
-        d_vy_[i] = (fy[i] - B * vy_[i] - C * y_[i]) / m_[i];
-    }
+        float s = std::sqrt(vx * vx + vy * vy);
+        if (s > EPSILON_) {
+            const float scale = std::min(Vmax, s) / s * pins_[i];
+            vx *= scale;
+            vy *= scale;
+            s *= scale;
+        }
 
-    for (size_t i = 0; i < vx_.size(); ++i) vx_[i] += d_vx_[i];
-    for (size_t i = 0; i < vy_.size(); ++i) vy_[i] += d_vy_[i];
-
-    for (size_t i = 0; i < vx_.size(); ++i) {
-        float vx_sq = vx_[i] * vx_[i];
-        float vy_sq = vy_[i] * vy_[i];
-        float s = std::sqrt(vx_sq + vy_sq);
-        float s_max = std::min(Vmax, s);
-        if (s <= EPSILON_) continue;
-        vx_[i] *= s_max / s * pins_[i];
-        vy_[i] *= s_max / s * pins_[i];
-    }
+        //a settled node only sleeps if it would barely move from rest
+        if (settling && settling_[i] && dT * s < sleep_tolerance_) {
+            awake_[i] = 0;
+            moving_[i] = 0;
+            calm_[i] = static_cast<uint16_t>(sleep_steps_);
+            vx_[i] = 0.0f;
+            vy_[i] = 0.0f;
+            bounds_.expand(x_[i], y_[i], rad_[i]);
+            cells_[i] = grid_.cells(x_[i], y_[i], rad_[i]);
+            continue;
+        }
 
-    for (size_t i = 0; i < x_.size(); ++i) x_[i] += dT * vx_[i];
-    for (size_t i = 0; i < y_.size(); ++i) y_[i] += dT * vy_[i];
+        //every node moves dT * |v| so the largest displacement comes from the fastest node
+        energy += 0.5 * m_[i] * s * s;
+        v_max = std::max(v_max, s);
+
+        moving_[i] = dT * s >= sleep_tolerance_;
+        calm_[i] = moving_[i] ? 0 : calm_[i] + 1;
+        if (sleep_steps_ > 0 && calm_[i] >= sleep_steps_) {
+            awake_[i] = 0;
+            vx = 0.0f;
+            vy = 0.0f;
+        }
+
+        vx_[i] = vx;
+        vy_[i] = vy;
+        x_[i] += dT * vx;
+        y_[i] += dT * vy;
 
-    for (size_t i = 0; i < ptrs_.size(); ++i) {
         Node &n = *ptrs_[i];
         n.pos.x = x_[i];
         n.pos.y = y_[i];
+
+        bounds_.expand(x_[i], y_[i], rad_[i]);
+        cells_[i] = grid_.cells(x_[i], y_[i], rad_[i]);
     }
+    max_velocity_ = v_max;
+    kinetic_energy_ = static_cast<float>(energy);
+    max_displacement_ = dT * max_velocity_;
+    settling_.clear();
+
+    grid_.fill(cells_);
+    grid_dirty_ = false;
 
     return ++iteration_;
 }
 
+size_t
+Network::run_until_converged(float tolerance, size_t max_steps) {
+    size_t steps = 0;
+    while (steps < max_steps) {
+        simulate_step();
+        ++steps;
+        if (converged(tolerance)) break;
+    }
+    return steps;
+}
+
 float
 Network::max_velocity() const {
     return max_velocity_;
 }
 
+bool
+Network::converged(float tolerance) const {
+    return iteration_ > 0 && max_displacement_ < tolerance;
+}
+
 void
-Network::pin_node(size_t id) { 
-    for (size_t i=0; i<ptrs_.size(); ++i) {
-        if (ptrs_[i]->id() == id) {
-            vx_[i] = 0.0f;
-            vy_[i] = 0.0f;
-            pins_[i] = 0;
-            break;
-        }
+Network::set_sleep(float tolerance, size_t steps) {
+    sleep_tolerance_ = tolerance;
+    sleep_steps_ = std::min<size_t>(steps, UINT16_MAX);
+    wake_all();
+}
+
+void
+Network::wake_all() {
+    std::fill(awake_.begin(), awake_.end(), 1);
+    std::fill(moving_.begin(), moving_.end(), 1);
+    std::fill(calm_.begin(), calm_.end(), 0);
+}
+
+void
+Network::wake(size_t i) {
+    //a node that is marked moving wakes its neighbours during the next step
+    awake_[i] = 1;
+    moving_[i] = 1;
+    calm_[i] = 0;
+}
+
+size_t
+Network::sleeping() const {
+    return std::count(awake_.begin(), awake_.end(), 0);
+}
+
+uint32_t
+Network::sim_index(size_t id) const {
+    if (!contains(id) || sim_index_.empty()) return NONE;
+    return sim_index_[id_index_[id]];
+}
+
+uint32_t
+Network::intern_nts(std::string_view seq, size_t &filtered) {
+    //only valid sequences are interned, so a hit needs no filtering
+    uint32_t id = nts_pool_.find(seq);
+    if (id == SequencePool::NONE) {
+        std::string valid;
+        size_t f = 0;
+        std::tie(valid, f) = make_valid_dna(seq);
+        filtered += f;
+        id = nts_pool_.intern(valid);
     }
+    return id;
+}
+
+size_t
+Network::assign_sequences(const std::vector<std::string> &seqs) {
+    size_t filtered = 0;
+    for (Node &n : nodes_) n.nts_id_ = intern_nts(seqs.at(n.id_), filtered);
+
+    std::vector<uint32_t> pending;
+    std::vector<std::string_view> nts;
+    translations_.resize(nts_pool_.size(), NONE);
+    for (uint32_t i = 0; i < nts_pool_.size(); ++i) {
+        if (translations_[i] != NONE) continue;
+        pending.push_back(i);
+        nts.push_back(nts_pool_[i]);
+    }
+
+    //translate in parallel, intern in id order so the ids do not depend on threading
+    std::vector<std::string> aas = translate_all(nts);
+    for (size_t k = 0; k < pending.size(); ++k) translations_[pending[k]] = aas_pool_.intern(aas[k]);
+
+    for (Node &n : nodes_) n.aas_id_ = translations_[n.nts_id_];
+    return filtered;
+}
+
+uint32_t
+Network::translation(uint32_t i) {
+    if (translations_.size() <= i) translations_.resize(nts_pool_.size(), NONE);
+    if (translations_[i] == NONE) translations_[i] = aas_pool_.intern(translate(nts_pool_[i]));
+    return translations_[i];
+}
+
+void
+Network::pin_node(size_t id) { 
+    const uint32_t i = sim_index(id);
+    if (i == NONE) return;
+    vx_[i] = 0.0f;
+    vy_[i] = 0.0f;
+    pins_[i] = 0;
+    wake(i);
 }
 
 void
 Network::unpin_node(size_t id) {
-    for (size_t i=0; i < ptrs_.size(); ++i) {
-        if (ptrs_[i]->id() == id) {
-            pins_[i] = 1;
-            break;
-        }
-    }
+    const uint32_t i = sim_index(id);
+    if (i == NONE) return;
+    pins_[i] = 1;
+    wake(i);
 }
 
 void Network::translate_node(size_t id, double dx, double dy) {
-    Node *n = nullptr;
-    for (size_t i = 0; i < ptrs_.size(); ++i) {
-        if (ptrs_[i]->id() == id) {
-            n = ptrs_[i];
-            x_[i] += dx;
-            y_[i] += dy;
-            n->pos.x += dx;
-            n->pos.y += dy;
-            break;
-        }
-    }
+    const uint32_t i = sim_index(id);
+    if (i == NONE) return;
+    Node *n = ptrs_[i];
+    x_[i] += dx;
+    y_[i] += dy;
+    n->pos.x += dx;
+    n->pos.y += dy;
+    bounds_.expand(x_[i], y_[i], rad_[i]);
+    grid_dirty_ = true;
+    wake(i);
+}
+
+void
+Network::update_grid() {
+    if (!grid_dirty_) return;
+    grid_.build(x_, y_, rad_);
+    grid_dirty_ = false;
 }
 
 Node *
 Network::pick(Vec2 p) {
-    for (auto ri = ptrs_.rbegin(); ri != ptrs_.rend(); ++ri) {
-        Node *n = *ri;
+    update_grid();
+
+    //candidates are in z order so the last hit is the one drawn on top
+    std::span<const uint32_t> candidates = grid_.candidates(p.x, p.y);
+    for (auto ri = candidates.rbegin(); ri != candidates.rend(); ++ri) {
+        Node *n = ptrs_[*ri];
         if (p.dist(n->pos) < n->r) return n; 
     }
     return nullptr;
 }
 
+std::vector<Node *>
+Network::query(const BBox &box) {
+    update_grid();
+
+    std::vector<uint32_t> hits;
+    grid_.visit(box.lo.x, box.lo.y, box.hi.x, box.hi.y, [&](uint32_t i) {
+        //distance from the node center to the nearest point of the box
+        const Node *n = ptrs_[i];
+        const float dx = n->pos.x - std::clamp(n->pos.x, box.lo.x, box.hi.x);
+        const float dy = n->pos.y - std::clamp(n->pos.y, box.lo.y, box.hi.y);
+        if (dx * dx + dy * dy < n->r * n->r) hits.push_back(i);
+    });
+
+    //nodes spanning several cells are found more than once
+    std::sort(hits.begin(), hits.end());
+    hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+
+    std::vector<Node *> nodes;
+    nodes.reserve(hits.size());
+    for (uint32_t i : hits) nodes.push_back(ptrs_[i]);
+    return nodes;
+}
+
 size_t
 Network::remove_inferred_leaves() {
-    size_t initial_count = nodes_.size();
-    for (;;) {
-        int erased = false;
-        for (auto ii = nodes_.begin(); ii != nodes_.end(); ) {
-            Node &n = ii->second;
-            if (n.is_leaf() && n.inferred == n.total) {
-                erased = true;
-                if (!n.is_root()) n.parent()->remove_child(&n);
-                ii = nodes_.erase(ii);
-            } else {
-                ++ii;
-            }
-        }
-        if (!erased) break;
+    auto inferred_only = [](const Node &n) { return n.inferred == n.total; };
+
+    std::vector<uint32_t> remaining(nodes_.size(), 0);
+    for (uint32_t p : parents_) if (p != NONE) ++remaining[p];
+
+    //start from the leaves and walk up while whole subtrees are inferred
+    std::vector<uint32_t> leaves;
+    for (uint32_t i = 0; i < nodes_.size(); ++i) {
+        if (remaining[i] == 0 && inferred_only(nodes_[i])) leaves.push_back(i);
     }
-    return initial_count - nodes_.size();
+
+    std::vector<uint8_t> keep(nodes_.size(), 1);
+    size_t removed = 0;
+    while (!leaves.empty()) {
+        const uint32_t i = leaves.back();
+        leaves.pop_back();
+        keep[i] = 0;
+        ++removed;
+
+        const uint32_t p = parents_[i];
+        parents_[i] = NONE;
+        if (p != NONE && --remaining[p] == 0 && inferred_only(nodes_[p])) leaves.push_back(p);
+    }
+
+    if (removed) compact(keep);
+    return removed;
 }
 
 Constant::Constant(float value, float minimum, float maximum) 
@@ -24,8 +24,12 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef CCB_NETWORK_H_
 #define CCB_NETWORK_H_
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
 #include <tuple>
-#include <map>
+#include <type_traits>
 #include <span>
 #include <string>
 #include <string_view>
@@ -33,6 +37,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <unordered_map>
 #include <vector>
 
+#include "sequence_pool.h"
+#include "spatial_grid.h"
 #include "util.h"
 #include "style.h"
 
@@ -61,6 +67,23 @@ Vec2::dist(Vec2 v) const {
     return sqrtf(dx * dx + dy * dy);
 }
 
+/** Axis aligned bounding box. Empty until expanded. */
+struct BBox {
+    Vec2 lo = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    Vec2 hi = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+
+    /** Check if nothing has been added yet */
+    bool empty() const { return lo.x > hi.x; }
+
+    /** Grow to include a circle of radius r at (x, y) */
+    void expand(float x, float y, float r) {
+        lo.x = std::min(lo.x, x - r);
+        lo.y = std::min(lo.y, y - r);
+        hi.x = std::max(hi.x, x + r);
+        hi.y = std::max(hi.y, y + r);
+    }
+};
+
 /** Represents one of the physical constants in the physics simulation */
 struct Constant {
     /** Construct an empty constant */
@@ -100,7 +123,11 @@ private:
     float maxv_ = 1.0f;
 };
 
+struct Network;
+
 /** Represents a node in the tree and also the inbound edge from its parent.
+* Nodes live in their Network, which owns the topology; adding or removing
+* Nodes invalidates pointers and references to them.
 * The following must be true at all times:<br/>
 * 1) the Node with id 0 is the root
 * 2) the id of each node in the network is unique
@@ -108,9 +135,6 @@ private:
 struct Node {
     friend struct Network;
 
-    /** Construct Node with given id */
-    Node(size_t id) : id_(id) { }
-
     /** Value for centroid_id for nodes that aren't centroids. */
     static const int NA;
 
@@ -146,6 +170,9 @@ struct Node {
     /** Get the Node id */
     size_t id() const { return id_; }
 
+    /** Get the position of this Node in Network::nodes(). */
+    size_t index() const { return index_; }
+
     /** Set the associated nucleotide sequence. Filters non-ACTG characters.
     * Case insensitive. Also translates the sequence: see aas().
     * @param seq string_view of nucleotides
@@ -154,71 +181,76 @@ struct Node {
     size_t nts(std::string_view seq);
 
     /** Get the associated nucleotide sequence. */
-    const std::string &nts() const { return nts_; }
+    inline const std::string &nts() const;
 
     /** Get the associated amino acid sequence. */
-    const std::string &aas() const { return aas_; }
-    
-    /** Pointer to parent */
-          Node *parent()       { return parent_; }
-    const Node *parent() const { return parent_; }
+    inline const std::string &aas() const;
 
-    /** Const access to child pointers */
-    const std::unordered_set<Node *> children() const { return children_; }
+    /** Get the id of nts() in Network::nucleotides(). Equal ids mean equal sequences. */
+    uint32_t nts_id() const { return nts_id_; }
 
-    /** Non-const access to children */
-    auto begin()       { return children_.begin();  }
+    /** Get the id of aas() in Network::translations(). Equal ids mean equal translations. */
+    uint32_t aas_id() const { return aas_id_; }
+    
+    /** Pointer to parent */
+    inline       Node *parent();
+    inline const Node *parent() const;
 
-    /** Const access to children */
-    auto begin() const { return children_.cbegin(); }
+    /** Get the children, ordered by id. */
+    inline std::span<Node * const> children() const;
 
-    /** Non-const access to children */
-    auto end()       { return children_.end();  }
+    /** Iterate over children */
+    auto begin() const { return children().begin(); }
 
-    /** Const access to children */
-    auto end() const { return children_.cend(); }
+    /** Iterate over children */
+    auto end()   const { return children().end(); }
 
-    /** Add a child and set pointers */
-    void add_child(Node *);
+    /** Make c a child of this Node */
+    void add_child(Node *c);
 
     /** Remove child c and set its parent pointer to null. */
     void remove_child(Node *c);
    
     /** Check if root */
-    bool is_root() const { return nullptr == parent_; }
+    inline bool is_root() const;
 
     /** Check if leaf */
-    bool is_leaf() const { return children_.empty();  }
+    bool is_leaf() const { return children().empty();  }
 
     /** Check if node is not connected to any other. */
-    bool is_disconnected() const { return !parent_ && children_.empty(); }
+    bool is_disconnected() const { return is_root() && is_leaf(); }
 
 private:
-    /** Pointer to our parent Node */
-    Node *parent_ = nullptr;
+    /** Construct Node with given id at position index of net */
+    Node(Network *net, size_t id, uint32_t index) : net_(net), index_(index), id_(id) { }
 
-    /** Incorporate a child into this, increasing total and setting appropriate pointers. */
-    void merge_child(Node *c);
+    /** The Network holding this Node and its topology */
+    Network *net_ = nullptr;
 
-    /** Incorporase a sibling into this, increasing total and setting appropriate pointers. */
-    void merge_sibling(Node *s);
+    uint32_t index_ = 0;
 
     size_t id_ = 0;
 
-    /** Nucleotide sequence associated with this Node */
-    std::string nts_;
+    /** Nucleotide sequence associated with this Node, interned by the Network */
+    uint32_t nts_id_ = 0;
 
-    /** Translation of nts */
-    std::string aas_;
-
-    /** Pointers to children */
-    std::unordered_set<Node *> children_;
+    /** Translation of nts, interned by the Network */
+    uint32_t aas_id_ = 0;
 };
 
-/** Network holds the tree structure and performs the physics simulation with it. */
+/** Network holds the tree structure and performs the physics simulation with it.
+* Nodes are stored densely in id order. The tree is kept as an array of parent
+* indices from which compressed child lists are rebuilt after topology edits.
+*/
 struct Network {
+    friend struct Node;
+
     Network();
 
+    //Nodes point back at their Network
+    Network(const Network &) = delete;
+    Network &operator=(const Network &) = delete;
+
     /** Create/add a node with the given id and return a reference to it.
     * @param id must be unique and the id of root must be 0
     */
@@ -234,27 +266,42 @@ struct Network {
      */
     void add_edge(size_t i, size_t j, float weight = 1.0f, float confidence=1.0f);
 
-    /** Get a reference to Node with id=i */
-    Node &node(size_t i)       { return nodes_.at(i); }
+    /** Get a reference to Node with id=i. Throws std::out_of_range if there is none. */
+    Node &node(size_t i)       { return nodes_[index_of(i)]; }
+
+    /** Get a const reference to Node with id=i. Throws std::out_of_range if there is none. */
+    const Node &node(size_t i) const { return nodes_[index_of(i)]; }
+
+    /** Check if there is a Node with id=i. */
+    bool contains(size_t i) const { return i < id_index_.size() && id_index_[i] != NONE; }
 
-    /** Non-const access to nodes_ */
+    /** Non-const access to Nodes in id order */
     auto begin() { return nodes_.begin(); }
 
-    /** Non-const access to nodes_ */
+    /** Non-const access to Nodes in id order */
     auto end()   { return nodes_.end();   }
 
-    /** Const access to nodes_ */
-    auto begin() const { return nodes_.begin(); }
+    /** Const access to Nodes in id order */
+    auto begin() const { return nodes_.cbegin(); }
 
-   /** Const access to nodes_ */
-    auto end()   const { return nodes_.end();   }
+   /** Const access to Nodes in id order */
+    auto end()   const { return nodes_.cend();   }
 
+    /** Get const access to Nodes sorted by id. */
+    const std::vector<Node> &nodes() const { return nodes_; }
 
-    /** Get a const reference to Node with id=i. */
-    const Node &node(size_t i) const { return nodes_.at(i); }
+    /** Set the nucleotide sequence of the Node with id i to seqs[i] for every
+    * Node, see Node::nts(). Distinct sequences are translated in parallel.
+    * @return the number of invalid characters filtered
+    * @throw std::out_of_range if a Node id has no sequence
+    */
+    size_t assign_sequences(const std::vector<std::string> &seqs);
 
-    /** Get const access to Nodes sorted by id. */
-    const std::map<size_t, Node> &nodes() const { return nodes_; }
+    /** Get the distinct nucleotide sequences of the Nodes, see Node::nts_id(). */
+    const SequencePool &nucleotides() const { return nts_pool_; }
+
+    /** Get the distinct translations of the Nodes, see Node::aas_id(). */
+    const SequencePool &translations() const { return aas_pool_; }
 
     /** Label nodes with given ids (excluding root) as centroids. */
     void identify_centroids(const std::vector<size_t> &centroid_ids);
@@ -272,101 +319,356 @@ struct Network {
     const std::vector<Node *> z_ordered_nodes() const { return ptrs_; }
 
     void init_simulation();
+
+    /** Copy the pos of every Node into the simulation and bring all Nodes to rest.
+    * Call after init_simulation() once a layout engine (see layout.h) has
+    * placed the Nodes.
+    */
+    void load_positions();
+
+    /** Like load_positions() but the Nodes in settled are put to sleep (see
+    * set_sleep()) after the next step, unless the complete forces of that step
+    * would move them. Use when most Nodes are already at rest, e.g. after
+    * carrying over a previous layout, so only the disturbed region converges.
+    */
+    void load_positions(const std::unordered_set<const Node *> &settled);
+
+    /** Advance the simulation by one time step. Also updates max_velocity(),
+    * kinetic_energy() and max_displacement().
+    * @return the number of steps simulated since init_simulation()
+    */
     size_t simulate_step();
 
+    /** Step the simulation until it has converged (see converged()) or
+    * max_steps steps have been simulated. Intended for headless use.
+    * @param tolerance the largest allowed node displacement per step
+    * @param max_steps give up after this many steps
+    * @return the number of steps simulated
+    */
+    size_t run_until_converged(float tolerance, size_t max_steps);
+
+    /** Get the largest node speed after the last step. */
     float max_velocity() const;
 
+    /** Get the total kinetic energy (sum of m*v^2/2) after the last step. */
+    float kinetic_energy() const { return kinetic_energy_; }
+
+    /** Get the largest distance any node moved during the last step. */
+    float max_displacement() const { return max_displacement_; }
+
+    /** Check if at least one step has been simulated and no node moved
+    * farther than tolerance during the last step.
+    */
+    bool converged(float tolerance) const;
+
+    /** Make the simulation bit-reproducible for a given input, independent
+    * of the number of threads. The initial placement is drawn from a seeded
+    * generator and the pairwise forces are cut into a fixed number of chunks
+    * whose partial sums are combined in a fixed pairwise order. All cores are
+    * still used. Call before init_simulation() for a reproducible start.
+    * @param deterministic true to enable, false for the default mode
+    * @param seed seed for the initial placement
+    */
+    void set_deterministic(bool deterministic, uint32_t seed = 0);
+
+    /** Check if the simulation runs in deterministic mode. */
+    bool deterministic() const { return deterministic_; }
+
+    /** Get the seed used for the initial placement in deterministic mode. */
+    uint32_t seed() const { return seed_; }
+
+    /** Set the number of worker threads, 0 for one less than the number of cores. */
+    void set_workers(size_t workers);
+
+    /** Get the box enclosing every node (including radius) after the last
+    * step. Computed as a by-product of integration, translate_node() only
+    * ever grows it.
+    */
+    const BBox &bounds() const { return bounds_; }
+
+    /** Configure sleeping. A node that moves less than tolerance per step
+    * for steps consecutive steps is put to sleep: it is left out of
+    * integration and its interactions with other sleeping nodes are skipped.
+    * Sleeping nodes wake when a node tied to them or close by moves, when
+    * they are pinned, unpinned or translated and when any constant changes.
+    * @param tolerance displacement per step below which a node is calm
+    * @param steps number of calm steps before sleeping, 0 disables sleeping
+    */
+    void set_sleep(float tolerance, size_t steps);
+
+    /** Wake every sleeping node. */
+    void wake_all();
+
+    /** Get the number of nodes currently asleep. */
+    size_t sleeping() const;
+
     void pin_node(size_t id);
     void unpin_node(size_t id);
     void translate_node(size_t id, double dx, double dy);
 
+    /** Get the topmost (in z order) Node whose circle contains p, or nullptr.
+    * Answered from a uniform grid that simulate_step() fills as it moves the
+    * Nodes, and that is only rebuilt here after other moves, e.g. translate_node().
+    */
     Node *pick(Vec2 p);
 
+    /** Get the Nodes whose circles overlap box, in z order ascending.
+    * Uses the same index as pick(), e.g. for rubber-band selection.
+    */
+    std::vector<Node *> query(const BBox &box);
+
+    /** Repeatedly remove leaves that consist only of inferred sequences.
+    * Done in one bottom-up pass: a Node goes once all of its children have.
+    * @return the number of Nodes removed
+    */
     size_t remove_inferred_leaves();
 
-    template<typename F>
-    void consolidate(F f, Node *root = nullptr);
+    /** Merge every descendant of a Node n connected to it through Nodes with
+    * key(n) into n, then every group of siblings with the same key into one,
+    * and remove the merged Nodes.
+    * Keys are hashed once per Node with std::hash and children are grouped
+    * by hash, so the whole tree is consolidated in expected linear time.
+    * @param key returns a hashable, equality comparable key for a const Node*
+    */
+    template<typename K>
+    void consolidate(K key, Node *root = nullptr);
 
           Constant &constant(char c) { return params_.at(c); }
     const Constant &constant(char c) const { return params_.at(c); }
 
+    /** Get const access to all Constants keyed by their one letter names. */
+    const std::unordered_map<char, Constant> &constants() const { return params_; }
+
 private:
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
     void label_centroids();
 
+    /** Get the index in nodes_ of the Node with id=i, throws std::out_of_range. */
+    uint32_t index_of(size_t i) const;
+
+    /** Get the index in ptrs_ of the Node with id=i, NONE if there is none
+    * or init_simulation() has not been called since Nodes were added or removed.
+    */
+    uint32_t sim_index(size_t i) const;
+
+    /** Get the nts_pool_ id of seq made valid, adding the number of characters filtered to filtered. */
+    uint32_t intern_nts(std::string_view seq, size_t &filtered);
+
+    /** Get the aas_pool_ id of the translation of nts_pool_ entry i, translating it once. */
+    uint32_t translation(uint32_t i);
+
+    /** Rebuild child_start_ and child_ptrs_ if the topology or storage changed. */
+    void update_children() const;
+
+    /** Remove the Nodes with keep[i] == 0, compacting nodes_ and the topology. */
+    void compact(const std::vector<uint8_t> &keep);
+
+    /** Add the counts of the Node at index b to the one at a and detach b. */
+    void merge_counts(uint32_t a, uint32_t b);
+
+    /** Wake the node at index i of ptrs_ and, on the next step, its neighbours. */
+    void wake(size_t i);
+
+    /** Get the values of B, C, E, G, K, V and T in that order. */
+    std::array<float, 7> constant_values() const;
+
+    /** Drop the simulation state after Nodes were added or removed. */
+    void clear_simulation();
+
+    /** Size the per-chunk force buffers for the current mode and thread count. */
+    void allocate_chunks();
+
+    /** Rebuild grid_ if any Node moved since it was last built. */
+    void update_grid();
+
+    /** Recompute bounds_ from scratch. */
+    void update_bounds();
+
     std::unordered_map<char, Constant> params_;
 
     float EPSILON_ = 0.0001f; //prevent div 0
 
     size_t iteration_ = 0;
     float max_velocity_ = 0.0f;
-
-    std::map<size_t, Node> nodes_;
+    float kinetic_energy_ = 0.0f;
+    float max_displacement_ = 0.0f;
+    BBox bounds_;
+    SpatialGrid grid_;         //index into ptrs_ for pick() and query()
+    bool grid_dirty_ = true;
+    std::vector<SpatialGrid::Cells> cells_; //grid cells of each node, binned during integration
+    float min_cell_ = 0.0f;    //smallest grid cell, the mean node diameter
+
+    float sleep_tolerance_ = 0.001f;
+    size_t sleep_steps_ = 30;
+    std::array<float, 7> constants_seen_ = {}; //constant_values() at the last step
+
+    std::vector<Node> nodes_;         //sorted by id
+    std::vector<uint32_t> id_index_;  //index in nodes_ by id, NONE for unused ids
+    std::vector<uint32_t> parents_;   //index in nodes_ of each Node's parent, NONE for roots
+    mutable std::vector<uint32_t> child_start_; //children of node i are child_ptrs_[child_start_[i]..child_start_[i+1])
+    mutable std::vector<Node *> child_ptrs_;
+    mutable bool children_dirty_ = true;
     std::vector<Node *> centroids_; //centroids sorted by child count, ascending
 
-    size_t n_workers_;
+    SequencePool nts_pool_;
+    SequencePool aas_pool_;
+    std::vector<uint32_t> translations_; //aas_pool_ id by nts_pool_ id, NONE until translated
+
+    bool deterministic_ = false;
+    uint32_t seed_ = 0;
+    size_t workers_ = 0;       //requested thread count, 0 for automatic
+    size_t n_workers_ = 1;
 
-    std::vector<Node *> ptrs_; //nodes by child count
+    std::vector<Node *> ptrs_; //nodes by z
+    std::vector<uint32_t> sim_index_; //index in ptrs_ by index in nodes_
     std::vector<int8_t> pins_; //0 for pinned nodes otherwise 1
     std::vector<float> x_;     //node x position
     std::vector<float> y_;     //node y position
     std::vector<float> m_;     //node mass
-    std::vector<float> l_;     //spring lengths
-    std::vector<float> s_;     //springs
-    std::vector<std::vector<float>> fxs_;
+    std::vector<float> rad_;   //node radius
+    std::vector<uint32_t> spring_a_; //springs run along tree edges between
+    std::vector<uint32_t> spring_b_; //spring_a_[e] and spring_b_[e]
+    std::vector<float> spring_l_;    //spring lengths
+    std::vector<std::vector<float>> fxs_;     //per chunk forces
     std::vector<std::vector<float>> fys_;
+    std::vector<std::vector<uint8_t>> wakes_; //per chunk wake flags
+    std::vector<uint8_t> awake_;   //0 for sleeping nodes otherwise 1
+    std::vector<uint8_t> moving_;  //1 if the node moved at least sleep_tolerance_ last step
+    std::vector<uint16_t> calm_;   //consecutive steps the node has not been moving
+    std::vector<uint8_t> settling_; //1 for nodes to put to sleep after the next step if at rest, empty if none
+    std::vector<uint32_t> active_; //indices of awake nodes, ascending
+    std::vector<uint32_t> asleep_; //indices of sleeping nodes, ascending
     std::vector<float> vx_;    //node velocity x
     std::vector<float> vy_;    //node velocity y
-    std::vector<float> d_vx_;  //node delta velocity x
-    std::vector<float> d_vy_;  //node delta velocity y
 };
 
-template<typename F>
+Node *
+Node::parent() {
+    const uint32_t p = net_->parents_[index_];
+    return p == Network::NONE ? nullptr : &net_->nodes_[p];
+}
+
+const Node *
+Node::parent() const {
+    const uint32_t p = net_->parents_[index_];
+    return p == Network::NONE ? nullptr : &net_->nodes_[p];
+}
+
+std::span<Node * const>
+Node::children() const {
+    net_->update_children();
+    const uint32_t lo = net_->child_start_[index_];
+    const uint32_t hi = net_->child_start_[index_ + 1];
+    return std::span<Node * const>(net_->child_ptrs_.data() + lo, hi - lo);
+}
+
+bool
+Node::is_root() const {
+    return net_->parents_[index_] == Network::NONE;
+}
+
+const std::string &
+Node::nts() const {
+    return net_->nts_pool_[nts_id_];
+}
+
+const std::string &
+Node::aas() const {
+    return net_->aas_pool_[aas_id_];
+}
+
+template<typename K>
 void
-Network::consolidate(F f, Node *root) {
-    if (!root) root = &(nodes_.begin()->second);
-
-    size_t mergers = 0;
-    do {
-        mergers = 0;
-        {
-            std::vector<Node *> children(root->children_.begin(), root->children_.end());
-            for (Node *c : children) {
-                if (f(root, c)) {
-                    root->merge_child(c);
-                    ++mergers;
-                }
+Network::consolidate(K key, Node *root) {
+    using Key = std::decay_t<std::invoke_result_t<K, const Node *>>;
+    //siblings are compared pairwise below this, grouped by hash above it
+    constexpr size_t SMALL_GROUP = 8;
+
+    if (nodes_.empty()) return;
+    if (!root) root = &nodes_.front();
+
+    //merging works on a copy of the child lists, parents_ is kept current
+    std::vector<std::vector<uint32_t>> kids(nodes_.size());
+    for (uint32_t i = 0; i < nodes_.size(); ++i) {
+        if (parents_[i] != NONE) kids[parents_[i]].push_back(i);
+    }
+
+    std::vector<size_t> hashes(nodes_.size());
+    for (uint32_t i = 0; i < nodes_.size(); ++i) hashes[i] = std::hash<Key>{}(key(&nodes_[i]));
+    auto same = [&](uint32_t a, uint32_t b) {
+        return hashes[a] == hashes[b] && key(&nodes_[a]) == key(&nodes_[b]);
+    };
+
+    //top down, since merging siblings hands their children on to the survivor
+    std::vector<uint32_t> stack{ root->index_ };
+    std::vector<uint32_t> pending;
+    std::vector<uint32_t> distinct;
+    while (!stack.empty()) {
+        const uint32_t r = stack.back();
+        stack.pop_back();
+
+        //absorb every chain of descendants that share r's key
+        pending = std::move(kids[r]);
+        kids[r].clear();
+        distinct.clear();
+        for (size_t i = 0; i < pending.size(); ++i) {
+            const uint32_t c = pending[i];
+            if (same(r, c)) {
+                merge_counts(r, c);
+                pending.insert(pending.end(), kids[c].begin(), kids[c].end());
+                kids[c].clear();
+            } else {
+                distinct.push_back(c);
             }
         }
 
-        {
-            std::vector<Node *> siblings(root->children_.begin(), root->children_.end());
-            while (!siblings.empty()) {
-                Node *a = siblings.back();
-                siblings.pop_back();
-                for (size_t i = 0; i < siblings.size(); ) {
-                    if (f(a, siblings[i])) {
-                        a->merge_sibling(siblings[i]);
-                        siblings[i] = siblings.back();
-                        siblings.pop_back();
-                        ++mergers;
-                    } else {
-                        ++i;
+        //fold each group of siblings into its first member
+        std::unordered_map<size_t, uint32_t> groups;
+        if (distinct.size() > SMALL_GROUP) groups.reserve(distinct.size());
+        for (uint32_t c : distinct) {
+            uint32_t a = NONE;
+            if (distinct.size() <= SMALL_GROUP) {
+                for (uint32_t s : kids[r]) {
+                    if (same(s, c)) {
+                        a = s;
+                        break;
+                    }
+                }
+            } else {
+                //probe past hash collisions between different keys
+                for (size_t h = hashes[c];; ++h) {
+                    auto [it, inserted] = groups.try_emplace(h, c);
+                    if (inserted) break;
+                    if (key(&nodes_[it->second]) == key(&nodes_[c])) {
+                        a = it->second;
+                        break;
                     }
                 }
             }
+
+            if (a == NONE) {
+                parents_[c] = r;
+                kids[r].push_back(c);
+            } else {
+                merge_counts(a, c);
+                for (uint32_t gc : kids[c]) parents_[gc] = a;
+                kids[a].insert(kids[a].end(), kids[c].begin(), kids[c].end());
+                kids[c].clear();
+            }
         }
-    } while (mergers != 0);
 
-    for (Node *c : root->children_) consolidate(f, c);
+        stack.insert(stack.end(), kids[r].begin(), kids[r].end());
+    }
+    children_dirty_ = true;
 
     if (root->is_root()) {
-        for (auto ii = nodes_.begin(); ii != nodes_.end(); ) {
-            if (ii->second.is_disconnected()) {
-                ii = nodes_.erase(ii);
-            } else {
-                ++ii;
-            }
+        const uint32_t r = root->index_;
+        std::vector<uint8_t> keep(nodes_.size(), 1);
+        for (uint32_t i = 0; i < nodes_.size(); ++i) {
+            if (i != r && parents_[i] == NONE && kids[i].empty()) keep[i] = 0;
         }
+        compact(keep);
     }
 }
 
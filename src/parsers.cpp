@@ -22,147 +22,764 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <future>
 #include <iterator>
-#include <unordered_set>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <unordered_map>
 
+#include "mapped_file.h"
 #include "parsers.h"
 #include "util.h"
 
-std::vector<std::string>
-parse_dsa(std::istream &ifs) {
-    std::unordered_set<std::string> sequences;
+//below this many bytes records are parsed on the calling thread
+constexpr size_t PARALLEL_MIN_BYTES = 1 << 22;
+
+//streamed input is parsed in blocks of about this many bytes
+constexpr size_t STREAM_BLOCK_BYTES = 1 << 28;
+
+enum class Format { DSA, FASTA, TEXT };
+
+/** What precedes the records of a file: the ancestor and where the records start. */
+struct Prologue {
     std::string ancestor;
-    std::string line;
+    size_t body = 0;      //offset of the first record
+    size_t body_line = 1; //line number of the first record
+    bool ended = false;   //the input ends before any records
+};
 
-    size_t line_no = 0;
-    while (std::getline(ifs, line) && ++line_no) {
-                             //"#dna template sequence"
-        if (line.starts_with("#dna template sequence")) {
-            auto tokens = split(line, "\t");
-            ancestor = rstrip(tokens[1]);
-            std::transform(ancestor.begin(), ancestor.end(), ancestor.begin(), ::toupper);
-            break;
+/** A sequence and its hash, computed once on the worker that found it. */
+struct HashedSeq {
+    std::string_view seq;
+    size_t hash = 0;
+
+    bool operator==(const HashedSeq &o) const { return seq == o.seq; }
+};
+
+struct HashedSeqHash {
+    size_t operator()(const HashedSeq &s) const { return s.hash; }
+};
+
+/** Index of each sequence in a list of unique sequences. */
+using HashedSeqIndex = std::unordered_map<HashedSeq, size_t, HashedSeqHash>;
+
+/** The unique sequences of a chunk of records in the order they first appear,
+* with the number of times each was seen.
+*/
+struct ChunkSequences {
+    std::vector<HashedSeq> seqs;
+    std::vector<size_t> counts;    //parallel to seqs
+    size_t n_ancestor = 0;         //records equal to the ancestor
+    HashedSeqIndex index;          //into seqs
+    std::deque<std::string> owned; //sequences that don't appear verbatim in the input
+    bool stopped = false;          //a record in the chunk ends the input
+    bool any_length = false;       //keep sequences whose length differs from the ancestor's
+
+    //dsa annotations, parallel to seqs
+    std::vector<size_t> reads;          //summed UMI group sizes
+    std::vector<std::string_view> aas;  //amino acids of the first record
+    size_t ancestor_reads = 0;
+
+    /** Make room for the records expected in text. */
+    void reserve(std::string_view text, std::string_view ancestor);
+};
+
+/** Unique sequences merged from chunks in input order. Sequences are views into
+* the input or into owned deques, whose elements never move.
+*/
+struct UniqueSequences {
+    HashedSeqIndex index; //into order
+    std::vector<std::string_view> order;
+    std::vector<size_t> counts;
+    size_t n_ancestor = 0;
+    std::deque<std::deque<std::string>> owned; //a deque so views into the elements survive growth
+
+    bool annotated = false; //the chunks carry dsa annotations
+    std::vector<size_t> reads;
+    std::vector<std::string_view> aas;
+    size_t ancestor_reads = 0;
+
+    /** Add the sequences of chunk that are new and the counts of all of them,
+    * copying new ones that are views into transient, for input that won't
+    * outlive parsing.
+    */
+    void merge(ChunkSequences &&chunk, std::string_view transient);
+
+    /** Get ancestor followed by the unique sequences. The ancestor counts
+    * itself as well as the records equal to it.
+    */
+    SequenceCounts take(std::string &&ancestor);
+};
+
+void
+ChunkSequences::reserve(std::string_view text, std::string_view ancestor) {
+    //records are at least as long as the ancestor, short ones rarely come alone
+    index.reserve(text.size() / std::max<size_t>(ancestor.size(), 16));
+}
+
+void
+UniqueSequences::merge(ChunkSequences &&chunk, std::string_view transient) {
+    n_ancestor += chunk.n_ancestor;
+    ancestor_reads += chunk.ancestor_reads;
+
+    //the first chunk's index can be taken over when it holds no views to copy
+    if (index.empty() && transient.empty()) {
+        index = std::move(chunk.index);
+        for (const HashedSeq &h : chunk.seqs) order.push_back(h.seq);
+        counts = std::move(chunk.counts);
+        reads = std::move(chunk.reads);
+        aas = std::move(chunk.aas);
+        owned.push_back(std::move(chunk.owned));
+        return;
+    }
+
+    const char *lo = transient.data(), *hi = transient.data() + transient.size();
+    std::deque<std::string> copies;
+    auto keep = [&](std::string_view sv) { return lo <= sv.data() && sv.data() < hi ? std::string_view(copies.emplace_back(sv)) : sv; };
+    for (size_t i = 0; i < chunk.seqs.size(); ++i) {
+        HashedSeq h = chunk.seqs[i];
+        auto it = index.find(h);
+        if (it != index.end()) {
+            counts[it->second] += chunk.counts[i];
+            if (annotated) reads[it->second] += chunk.reads[i];
+            continue;
+        }
+        h.seq = keep(h.seq);
+        index.emplace(h, order.size());
+        order.push_back(h.seq);
+        counts.push_back(chunk.counts[i]);
+        if (annotated) {
+            reads.push_back(chunk.reads[i]);
+            aas.push_back(keep(chunk.aas[i]));
         }
     }
+    owned.push_back(std::move(chunk.owned));
+    owned.push_back(std::move(copies));
+}
+
+SequenceCounts
+UniqueSequences::take(std::string &&ancestor) {
+    SequenceCounts result;
+    result.seqs.reserve(order.size() + 1);
+    result.seqs.push_back(std::move(ancestor));
+    result.seqs.insert(result.seqs.end(), order.begin(), order.end());
+    result.counts.reserve(order.size() + 1);
+    result.counts.push_back(n_ancestor + 1);
+    result.counts.insert(result.counts.end(), counts.begin(), counts.end());
+    if (annotated) {
+        result.reads.reserve(reads.size() + 1);
+        result.reads.push_back(ancestor_reads);
+        result.reads.insert(result.reads.end(), reads.begin(), reads.end());
+        result.aas.reserve(aas.size() + 1);
+        result.aas.emplace_back();
+        result.aas.insert(result.aas.end(), aas.begin(), aas.end());
+    }
+    index.clear();
+    order.clear();
+    counts.clear();
+    n_ancestor = 0;
+    reads.clear();
+    aas.clear();
+    ancestor_reads = 0;
+    owned.clear();
+    return result;
+}
+
+/** Get the end of the line starting at pos, not including the '\n'. */
+size_t
+line_end(std::string_view text, size_t pos) {
+    if (pos >= text.size()) return text.size();
+    const char *nl = static_cast<const char *>(std::memchr(text.data() + pos, '\n', text.size() - pos));
+    return nl ? static_cast<size_t>(nl - text.data()) : text.size();
+}
+
+/** Get the start of the line after the one containing pos, text.size() if there is none. */
+size_t
+next_line(std::string_view text, size_t pos) {
+    return std::min(text.size(), line_end(text, pos) + 1);
+}
+
+//add_sequence() result for sequences that aren't in chunk.seqs
+constexpr size_t NOT_ADDED = std::numeric_limits<size_t>::max();
+
+/** Count seq in chunk unless it is empty or, without chunk.any_length, differs
+* from the ancestor in length, adding it if it is neither the ancestor nor seen before. raw is the text seq was read
+* from, kept as is if equal to seq.
+* @param count the number of reads seq stands for
+* @return the index of seq in chunk.seqs, NOT_ADDED if it was skipped or is the ancestor
+*/
+size_t
+add_sequence(ChunkSequences &chunk, const std::string &seq, std::string_view raw, std::string_view ancestor, size_t count = 1) {
+    if (seq.size() != ancestor.size() && (seq.empty() || !chunk.any_length)) return NOT_ADDED;
+    if (seq == ancestor) {
+        chunk.n_ancestor += count;
+        return NOT_ADDED;
+    }
+    HashedSeq h{seq, hash_dna(seq)};
+    auto it = chunk.index.find(h);
+    if (it != chunk.index.end()) {
+        chunk.counts[it->second] += count;
+        return it->second;
+    }
+    h.seq = (seq == raw) ? raw : std::string_view(chunk.owned.emplace_back(seq));
+    chunk.index.emplace(h, chunk.seqs.size());
+    chunk.seqs.push_back(h);
+    chunk.counts.push_back(count);
+    return chunk.seqs.size() - 1;
+}
+
+/** Get field n of a tab separated line without splitting the rest of it.
+* @return nullopt if line has n or fewer fields
+*/
+std::optional<std::string_view>
+tsv_field(std::string_view line, size_t n) {
+    size_t pos = 0;
+    for (; n; --n) {
+        const size_t tab = line.find('\t', pos);
+        if (tab == std::string_view::npos) return std::nullopt;
+        pos = tab + 1;
+    }
+    return line.substr(pos, std::min(line.find('\t', pos), line.size()) - pos);
+}
 
-    if (ancestor.empty())
-        throw std::runtime_error("Could not locate '#dna template sequence' column");
-    if (ancestor.find_first_not_of("ACGT") != std::string::npos)
-        throw std::runtime_error("Dna template seqeunce contained invalid (i.e., non-ACGT) characters");
+/** A FASTA record: a run of sequence lines, after any header lines. */
+struct FastaRecord {
+    size_t end = 0;              //offset after the record
+    size_t n_lines = 0;          //0 if the text held no record
+    std::string_view first_line;
+    bool blank = false;          //the record ended at a blank line, which ends the input
+};
 
-    bool found_alignments = false;
-    for (; std::getline(ifs, line); ++line_no) {
-        if (line.starts_with("#Alignments#")) {
-            found_alignments = true;
-            std::getline(ifs, line); //skip headers
-            ++line_no;
+/** Read the FASTA record at pos of text into seq. */
+FastaRecord
+read_fasta_record(std::string_view text, size_t pos, std::string &seq) {
+    FastaRecord r;
+    r.end = pos;
+    seq.clear();
+    while (r.end < text.size()) {
+        const size_t eol = line_end(text, r.end);
+        std::string_view line = rstrip(text.substr(r.end, eol - r.end));
+        if (line.empty()) {
+            r.blank = true;
             break;
+        } else if ('>' == line.front()) {
+            if (r.n_lines) break;
+        } else {
+            if (!r.n_lines++) r.first_line = line;
+            make_valid_dna(line, seq);
         }
+        r.end = std::min(text.size(), eol + 1);
     }
+    return r;
+}
 
-    if (!found_alignments)
-        throw std::runtime_error("#Alignments section could not be identified");
+/** Parse whole FASTA records. */
+ChunkSequences
+fasta_chunk_worker(std::string_view text, std::string_view ancestor, size_t, bool any_length) {
+    ChunkSequences chunk;
+    chunk.any_length = any_length;
+    chunk.reserve(text, ancestor);
+    std::string seq;
+    for (size_t pos = 0; pos < text.size() && !chunk.stopped; ) {
+        FastaRecord r = read_fasta_record(text, pos, seq);
+        if (r.n_lines) add_sequence(chunk, seq, r.n_lines == 1 ? r.first_line : std::string_view(), ancestor);
+        chunk.stopped = r.blank;
+        pos = r.end;
+    }
+    return chunk;
+}
 
-    size_t filtered=0;
-    for (; std::getline(ifs, line); ++line_no) {
-        if (line.starts_with("#")) break;
-        std::getline(ifs, line); ++line_no; //skip amino acids
-        auto tokens = split(line, "\t");
-        if (tokens.size() < 4)
+/** Parse one sequence per line. */
+ChunkSequences
+text_chunk_worker(std::string_view text, std::string_view ancestor, size_t, bool any_length) {
+    ChunkSequences chunk;
+    chunk.any_length = any_length;
+    chunk.reserve(text, ancestor);
+    std::string seq;
+    for (size_t pos = 0; pos < text.size(); pos = next_line(text, pos)) {
+        std::string_view line = text.substr(pos, line_end(text, pos) - pos);
+        seq.clear();
+        make_valid_dna(line, seq);
+        add_sequence(chunk, seq, line, ancestor);
+    }
+    return chunk;
+}
+
+/** Parse pairs of lines from the alignments section of a dsa file. The first
+* line of a pair holds the UMI group size in its second column and the amino
+* acids in its fourth, the fourth column of the second line the nucleotides.
+* Fields are found in place, nothing is allocated per line.
+*/
+ChunkSequences
+dsa_chunk_worker(std::string_view text, std::string_view ancestor, size_t first_line, bool any_length) {
+    ChunkSequences chunk;
+    chunk.any_length = any_length;
+    chunk.reserve(text, ancestor);
+    std::string seq;
+    size_t line_no = first_line + 1;
+    for (size_t pos = 0; pos < text.size(); line_no += 2) {
+        if ('#' == text[pos]) {
+            chunk.stopped = true;
+            break;
+        }
+        std::string_view annotation = text.substr(pos, line_end(text, pos) - pos);
+        pos = next_line(text, pos);
+        std::string_view line = text.substr(pos, line_end(text, pos) - pos);
+        pos = next_line(text, pos);
+
+        std::optional<std::string_view> nts = tsv_field(line, 3);
+        if (!nts)
             throw std::runtime_error("Invalid sequence data in line " + std::to_string(line_no));
-        std::string_view stripped = rstrip(tokens[3]);
-        std::tie(line, filtered) = make_valid_dna(stripped);
-        if (filtered)
+        std::string_view stripped = rstrip(*nts);
+        seq.clear();
+        if (make_valid_dna(stripped, seq))
             throw std::runtime_error("Sequence on line " + std::to_string(line_no) + " contained invalid (i.e., non-ACGT) characters");
-        if (line.empty())
+        if (seq.empty())
             throw std::runtime_error("empty sequence on line where DNA was expected " + std::to_string(line_no));
-        if (line.size() != ancestor.size()) continue;
-        sequences.insert(std::move(line));
-    }
-
-    sequences.erase(ancestor);
-    std::vector<std::string> output;
-    output.push_back(std::move(ancestor));
-    output.insert(output.cend(),
-                  std::make_move_iterator(sequences.begin()),
-                  std::make_move_iterator(sequences.end()));
-
-    if (output.empty()) throw std::runtime_error("File contained no usable data.");
-    return output;
-}
-
-std::vector<std::string>
-parse_fasta(std::istream &ifs) {
-    std::vector<std::string> seqs;
-    size_t line_no = 1;
-    std::string line;
-    bool start_new = true;
-    size_t filtered = 0;
-    for (; std::getline(ifs, line); ++line_no) {
-        std::string_view stripped = rstrip(line);
-        if (stripped.empty()) {
-            break;
-        } else if ('>' == stripped.front()) {
-            start_new = true;
-        } else if (start_new) {
-            start_new = false;
-            std::tie(line, filtered) = make_valid_dna(stripped);
-            seqs.push_back(std::move(line));
-            line.clear();
-        } else {
-            std::tie(line, filtered) = make_valid_dna(stripped);
-            seqs.back() += line;
+
+        //records without a group size stand for a single read
+        size_t group = 1;
+        if (std::optional<std::string_view> size = tsv_field(annotation, 1); size && !size->empty()) {
+            auto [end, ec] = std::from_chars(size->data(), size->data() + size->size(), group);
+            if (ec != std::errc() || end != size->data() + size->size())
+                throw std::runtime_error("Invalid UMI group size on line " + std::to_string(line_no - 1));
         }
+
+        const size_t i = add_sequence(chunk, seq, stripped, ancestor);
+        if (i == chunk.reads.size()) {
+            chunk.reads.push_back(group);
+            chunk.aas.push_back(rstrip(tsv_field(annotation, 3).value_or(std::string_view())));
+        } else if (i != NOT_ADDED) {
+            chunk.reads[i] += group;
+        } else if (seq == ancestor) {
+            chunk.ancestor_reads += group;
+        }
+    }
+    return chunk;
+}
+
+/** Get the offset of the first record boundary at or after pos. */
+size_t
+record_start(std::string_view text, size_t pos, Format format) {
+    if (pos == 0 || pos >= text.size()) return std::min(pos, text.size());
+    if (Format::FASTA == format) {
+        const size_t p = text.find("\n>", pos - 1);
+        return p == std::string_view::npos ? text.size() : p + 1;
+    }
+    return next_line(text, pos - 1);
+}
+
+/** Parse the whole records in text, split into chunks at record boundaries,
+* each on its own worker, and merge them into unique in order.
+* @param first_line the line number of the start of text
+* @param transient whether text goes away after parsing
+* @param any_length keep sequences whose length differs from the ancestor's
+* @return true if a record ended the input
+*/
+bool
+parse_records(std::string_view text, Format format, std::string_view ancestor, size_t first_line, UniqueSequences &unique, bool transient, bool any_length) {
+    const size_t n_workers = text.size() < PARALLEL_MIN_BYTES ? 1 : std::max(1U, std::thread::hardware_concurrency());
+
+    std::vector<size_t> cuts{0};
+    for (size_t w = 1; w < n_workers; ++w) {
+        cuts.push_back(std::max(cuts.back(), record_start(text, text.size() / n_workers * w, format)));
     }
+    cuts.push_back(text.size());
 
-    //get vector of unique sequences of same length keeping seqs[0] in place
-    if (seqs.empty()) throw std::runtime_error("File contained no usable data.");
+    //line numbers of the cuts, dsa records are pairs of lines so cuts must fall on even lines
+    std::vector<size_t> lines(cuts.size(), first_line);
+    if (Format::DSA == format && n_workers > 1) {
+        std::vector<std::future<size_t>> counts;
+        for (size_t c = 0; c + 1 < cuts.size(); ++c) {
+            counts.push_back(std::async(std::launch::async, [&, c]() {
+                return static_cast<size_t>(std::count(text.begin() + cuts[c], text.begin() + cuts[c + 1], '\n'));
+            }));
+        }
+        for (size_t c = 1; c < cuts.size(); ++c) lines[c] = lines[c - 1] + counts[c - 1].get();
+        for (size_t c = 1; c + 1 < cuts.size(); ++c) {
+            if ((lines[c] - first_line) % 2 == 0 || cuts[c] == text.size()) continue;
+            cuts[c] = next_line(text, cuts[c]);
+            ++lines[c];
+        }
+    }
 
-    std::unordered_set<std::string> uniq;
-    std::copy_if(
-        std::make_move_iterator(seqs.begin()+1),
-        std::make_move_iterator(seqs.end()    ),
-        std::inserter(uniq, uniq.end()),
-        [&seqs](const auto &s)->bool{ return s.size()==seqs.front().size(); }
-    );
-    uniq.erase(seqs.front());
-    seqs.resize(1);
-    std::copy(
-        std::make_move_iterator(uniq.begin()),
-        std::make_move_iterator(uniq.end()  ),
-        std::back_inserter(seqs)
-    );
+    decltype(&fasta_chunk_worker) worker = Format::FASTA == format ? fasta_chunk_worker
+                                         : Format::DSA == format ? dsa_chunk_worker
+                                         : text_chunk_worker;
 
-    return seqs;
+    std::vector<std::future<ChunkSequences>> chunks;
+    for (size_t c = 0; c + 1 < cuts.size(); ++c) {
+        std::string_view chunk = text.substr(cuts[c], cuts[c + 1] - cuts[c]);
+        chunks.push_back(std::async(std::launch::async, worker, chunk, ancestor, lines[c], any_length));
+    }
+
+    //a worker's error only counts if no earlier chunk ended the input
+    for (std::future<ChunkSequences> &f : chunks) {
+        ChunkSequences chunk = f.get();
+        const bool stopped = chunk.stopped;
+        unique.merge(std::move(chunk), transient ? text : std::string_view());
+        if (stopped) return true;
+    }
+    return false;
 }
 
-std::vector<std::string>
-parse_text(std::istream &ifs) {
-    std::string ancestor;
-    std::unordered_set<std::string> seqs;
+/** Find the ancestor and the first record in text.
+* @param complete whether text is the whole input
+* @return nullopt if more of the input is needed
+*/
+std::optional<Prologue>
+read_prologue(std::string_view text, Format format, bool complete) {
+    //only whole lines of partial input are looked at
+    if (!complete) text = text.substr(0, text.rfind('\n') + 1);
 
-    size_t filtered=0, line_no=1;
-    for (std::string line; std::getline(ifs, line); ++line_no) {
-        std::tie(line, filtered) = make_valid_dna(line);
-        if (seqs.empty()) {
-            ancestor = std::move(line);
-        } else {
-            seqs.insert(std::move(line));
+    Prologue p;
+    if (Format::FASTA == format) {
+        FastaRecord r = read_fasta_record(text, 0, p.ancestor);
+        if (!complete && !r.blank && r.end == text.size()) return std::nullopt;
+        if (!r.n_lines) throw std::runtime_error("File contained no usable data.");
+        p.body = r.end;
+        p.ended = r.blank;
+    } else if (Format::TEXT == format) {
+        p.body = next_line(text, 0);
+        p.body_line = 2;
+        if (p.body == text.size()) {
+            if (!complete) return std::nullopt;
+            throw std::runtime_error("File contained no usable data.");
+        }
+        make_valid_dna(text.substr(0, line_end(text, 0)), p.ancestor);
+    } else {
+        size_t pos = 0, line_no = 1;
+        for (; pos < text.size() && p.ancestor.empty(); pos = next_line(text, pos), ++line_no) {
+            std::string_view line = text.substr(pos, line_end(text, pos) - pos);
+            if (line.starts_with("#dna template sequence")) {
+                auto tokens = split(line, "\t");
+                p.ancestor = rstrip(tokens.size() > 1 ? tokens[1] : std::string_view());
+                std::transform(p.ancestor.begin(), p.ancestor.end(), p.ancestor.begin(), ::toupper);
+                if (p.ancestor.empty()) break;
+            }
+        }
+        if (p.ancestor.empty()) {
+            if (!complete) return std::nullopt;
+            throw std::runtime_error("Could not locate '#dna template sequence' column");
+        }
+        if (p.ancestor.find_first_not_of("ACGT") != std::string::npos)
+            throw std::runtime_error("Dna template seqeunce contained invalid (i.e., non-ACGT) characters");
+
+        bool found_alignments = false;
+        for (; pos < text.size(); pos = next_line(text, pos), ++line_no) {
+            if (text.substr(pos).starts_with("#Alignments#")) {
+                found_alignments = true;
+                break;
+            }
         }
-        line.clear();
+        //the alignments marker and the headers line after it are skipped
+        if (!complete && (!found_alignments || next_line(text, next_line(text, pos)) == text.size())) return std::nullopt;
+        if (!found_alignments)
+            throw std::runtime_error("#Alignments section could not be identified");
+        p.body = next_line(text, next_line(text, pos));
+        p.body_line = line_no + 2;
+    }
+    return p;
+}
+
+/** Parse the whole of data in parallel. */
+SequenceCounts
+parse_all(std::string_view data, Format format, bool any_length) {
+    Prologue p = *read_prologue(data, format, true);
+    UniqueSequences unique;
+    unique.annotated = Format::DSA == format;
+    if (!p.ended) parse_records(data.substr(p.body), format, p.ancestor, p.body_line, unique, false, any_length);
+    return unique.take(std::move(p.ancestor));
+}
+
+/** Append up to n bytes from ifs to block, return false once ifs is exhausted. */
+bool
+read_block(std::istream &ifs, std::string &block, size_t n) {
+    //small inputs shouldn't pay for a whole block
+    constexpr size_t READ_BYTES = 1 << 20;
+
+    for (size_t end = block.size() + n; ifs && block.size() < end; ) {
+        const size_t size = block.size();
+        const size_t count = std::min(READ_BYTES, end - size);
+        block.resize(size + count);
+        ifs.read(block.data() + size, count);
+        block.resize(size + ifs.gcount());
+    }
+    return static_cast<bool>(ifs);
+}
+
+/** Parse ifs a large block at a time, each block in parallel. */
+SequenceCounts
+parse_stream(std::istream &ifs, Format format, bool any_length) {
+    std::string block;
+    bool more = read_block(ifs, block, STREAM_BLOCK_BYTES);
+    std::optional<Prologue> p;
+    while (!(p = read_prologue(block, format, !more))) more = read_block(ifs, block, STREAM_BLOCK_BYTES);
+
+    UniqueSequences unique;
+    unique.annotated = Format::DSA == format;
+    block.erase(0, p->body);
+    size_t line = p->body_line;
+    bool ended = p->ended;
+    while (!ended) {
+        //cut after the last whole record, an even number of lines for dsa
+        size_t cut = block.size();
+        if (more) {
+            cut = Format::FASTA == format ? block.rfind("\n>") : block.rfind('\n');
+            cut = cut == std::string::npos ? 0 : cut + 1;
+            if (Format::DSA == format && std::count(block.begin(), block.begin() + cut, '\n') % 2) {
+                cut = cut > 1 ? block.rfind('\n', cut - 2) : std::string::npos;
+                cut = cut == std::string::npos ? 0 : cut + 1;
+            }
+        }
+
+        std::string_view records(block.data(), cut);
+        ended = parse_records(records, format, p->ancestor, line, unique, true, any_length);
+        if (Format::DSA == format) line += std::count(records.begin(), records.end(), '\n');
+        block.erase(0, cut);
+
+        if (!more) break;
+        more = read_block(ifs, block, STREAM_BLOCK_BYTES);
+    }
+
+    return unique.take(std::move(p->ancestor));
+}
+
+/** A lineage of an AIRR table being read: the germline of its first row and
+* the sequences of all its rows.
+*/
+struct AirrClone {
+    std::string germline;
+    ChunkSequences chunk;
+};
+
+/** Rows of an AIRR rearrangement table bucketed by clone_id, in the order
+* clones first appear.
+*/
+struct AirrLineages {
+    static constexpr size_t NONE = std::numeric_limits<size_t>::max();
+
+    //columns used, later ones are never split
+    size_t sequence = NONE, germline = NONE, clone = NONE, duplicates = NONE;
+    size_t last = 0;
+
+    bool header = false;
+    bool any_length = false; //keep sequences whose length differs from the germline
+    size_t line_no = 0;
+    uint64_t offset = 0;                           //of the text being read, in the whole input
+    std::unordered_map<std::string, size_t> index; //into clones
+    CloneIndex rows;                               //ids and byte ranges, parallel to clones
+    std::deque<AirrClone> clones;
+    std::vector<std::string_view> cells;
+    std::string seq;
+
+    /** Find the columns used in the header line, at range of the input. */
+    void read_header(std::string_view line, CloneIndex::Range range);
+
+    /** Add the sequence of a row, at range of the input, to its clone. */
+    void add_row(std::string_view line, CloneIndex::Range range);
+
+    /** Get the rows of every clone with a germline. */
+    CloneIndex lineage_rows() const;
+
+    /** Get a lineage for every clone with a germline. */
+    std::vector<Lineage> take();
+};
+
+void
+AirrLineages::read_header(std::string_view line, CloneIndex::Range range) {
+    std::vector<std::string_view> names = split(line, "\t");
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::string_view name = rstrip(names[i]);
+        if ("sequence_alignment" == name) sequence = i;
+        else if ("germline_alignment" == name) germline = i;
+        else if ("clone_id" == name) clone = i;
+        else if ("duplicate_count" == name) duplicates = i;
+    }
+    if (NONE == sequence) throw std::runtime_error("Could not locate 'sequence_alignment' column");
+    if (NONE == germline) throw std::runtime_error("Could not locate 'germline_alignment' column");
+    if (NONE == clone) throw std::runtime_error("Could not locate 'clone_id' column");
+    last = std::max({sequence, germline, clone, NONE == duplicates ? 0 : duplicates});
+    header = true;
+    rows.header = range;
+}
+
+void
+AirrLineages::add_row(std::string_view line, CloneIndex::Range range) {
+    cells.clear();
+    for (size_t pos = 0; cells.size() <= last && pos <= line.size(); ) {
+        const size_t tab = std::min(line.find('\t', pos), line.size());
+        cells.push_back(rstrip(line.substr(pos, tab - pos)));
+        pos = tab + 1;
+    }
+    if (cells.size() <= last) {
+        if (rstrip(line).empty()) return;
+        throw std::runtime_error("Too few columns on line " + std::to_string(line_no));
     }
 
-    if (seqs.empty()) throw std::runtime_error("File contained no usable data.");
+    //rows not assigned to a clone or standing for no reads are skipped
+    std::string_view id = cells[clone];
+    size_t count = 1;
+    if (NONE != duplicates && !cells[duplicates].empty()) {
+        std::string_view dups = cells[duplicates];
+        auto [end, ec] = std::from_chars(dups.data(), dups.data() + dups.size(), count);
+        if (ec != std::errc() || end != dups.data() + dups.size())
+            throw std::runtime_error("Invalid duplicate_count on line " + std::to_string(line_no));
+    }
+    if (id.empty() || 0 == count) return;
+
+    auto [it, added] = index.try_emplace(std::string(id), clones.size());
+    if (added) {
+        rows.add_clone(std::string(id));
+        clones.emplace_back().chunk.any_length = any_length;
+    }
+    rows.add_row(it->second, range);
+    AirrClone &c = clones[it->second];
+    if (c.germline.empty()) make_valid_dna(cells[germline], c.germline);
+    if (c.germline.empty()) return;
+
+    seq.clear();
+    make_valid_dna(cells[sequence], seq);
+    add_sequence(c.chunk, seq, std::string_view(), c.germline, count);
+}
+
+CloneIndex
+AirrLineages::lineage_rows() const {
+    CloneIndex lineages = rows;
+    lineages.ids.clear();
+    lineages.rows.clear();
+    lineages.ranges.clear();
+    for (size_t i = 0; i < clones.size(); ++i) {
+        if (clones[i].germline.empty()) continue;
+        lineages.ids.push_back(rows.ids[i]);
+        lineages.rows.push_back(rows.rows[i]);
+        lineages.ranges.push_back(rows.ranges[i]);
+    }
+    return lineages;
+}
+
+std::vector<Lineage>
+AirrLineages::take() {
+    if (!header) throw std::runtime_error("File contained no usable data.");
+    std::vector<Lineage> lineages;
+    for (size_t i = 0; i < clones.size(); ++i) {
+        if (clones[i].germline.empty()) continue;
+        UniqueSequences unique;
+        unique.merge(std::move(clones[i].chunk), std::string_view());
+        lineages.push_back(Lineage{std::move(rows.ids[i]), unique.take(std::move(clones[i].germline))});
+    }
+    index.clear();
+    rows = CloneIndex();
+    clones.clear();
+    return lineages;
+}
+
+/** Read the whole lines of text into lineages, the header first.
+* @param complete whether text ends the input, so a last line without a '\n' is whole
+* @return the offset after the last line read
+*/
+size_t
+read_airr_rows(std::string_view text, bool complete, AirrLineages &lineages) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        const size_t eol = line_end(text, pos);
+        if (eol == text.size() && !complete) break;
+        std::string_view line = text.substr(pos, eol - pos);
+        const size_t next = next_line(text, pos);
+        const CloneIndex::Range range{lineages.offset + pos, next - pos};
+        ++lineages.line_no;
+        if (!lineages.header) lineages.read_header(line, range);
+        else lineages.add_row(line, range);
+        pos = next;
+    }
+    return pos;
+}
+
+SequenceCounts
+parse_dsa(std::istream &ifs, bool keep_indels) {
+    return parse_stream(ifs, Format::DSA, keep_indels);
+}
+
+SequenceCounts
+parse_dsa(const fs::path &path, bool keep_indels) {
+    MappedFile file(path);
+    return parse_all(file.view(), Format::DSA, keep_indels);
+}
+
+SequenceCounts
+parse_fasta(std::istream &ifs, bool keep_indels) {
+    return parse_stream(ifs, Format::FASTA, keep_indels);
+}
+
+SequenceCounts
+parse_fasta(const fs::path &path, bool keep_indels) {
+    MappedFile file(path);
+    return parse_fasta(file.view(), keep_indels);
+}
+
+SequenceCounts
+parse_fasta(std::string_view data, bool keep_indels) {
+    return parse_all(data, Format::FASTA, keep_indels);
+}
+
+SequenceCounts
+parse_text(std::istream &ifs, bool keep_indels) {
+    return parse_stream(ifs, Format::TEXT, keep_indels);
+}
+
+SequenceCounts
+parse_text(const fs::path &path, bool keep_indels) {
+    MappedFile file(path);
+    return parse_all(file.view(), Format::TEXT, keep_indels);
+}
+
+std::vector<Lineage>
+parse_airr(std::istream &ifs, bool keep_indels) {
+    AirrLineages lineages;
+    lineages.any_length = keep_indels;
+    std::string block;
+    for (bool more = true; more; ) {
+        more = read_block(ifs, block, STREAM_BLOCK_BYTES);
+        const size_t used = read_airr_rows(block, !more, lineages);
+        block.erase(0, used);
+        lineages.offset += used;
+    }
+    return lineages.take();
+}
+
+std::vector<Lineage>
+parse_airr(const fs::path &path, bool keep_indels) {
+    MappedFile file(path);
+    AirrLineages lineages;
+    lineages.any_length = keep_indels;
+    lineages.rows = CloneIndex(path);
+    read_airr_rows(file.view(), true, lineages);
+    write_clone_index(path, lineages.lineage_rows()); //only speeds up later reads, so failure is fine
+    return lineages.take();
+}
+
+Lineage
+parse_airr_clone(const fs::path &path, const CloneIndex &index, size_t clone, bool keep_indels) {
+    MappedFile file(path);
+    std::string_view text = file.view();
+    if (text.size() != index.file_size)
+        throw std::runtime_error("Clone index of " + path.filename().string() + " is out of date");
+
+    AirrLineages lineages;
+    lineages.any_length = keep_indels;
+    read_airr_rows(text.substr(index.header.offset, index.header.size), true, lineages);
+    for (const CloneIndex::Range &r : index.ranges.at(clone)) {
+        lineages.offset = r.offset;
+        read_airr_rows(text.substr(r.offset, r.size), true, lineages);
+    }
 
-    seqs.erase(ancestor);
-    std::vector<std::string> output;
-    output.push_back(std::move(ancestor));
-    std::copy_if(
-        std::make_move_iterator(seqs.begin()),
-        std::make_move_iterator(seqs.end()  ),
-        std::back_inserter(output),
-        [&](auto &s)->bool{return s.size()==output.front().size();}
-    );
-    return output;
+    std::vector<Lineage> found = lineages.take();
+    if (found.size() != 1 || found.front().clone_id != index.ids[clone])
+        throw std::runtime_error("Clone " + index.ids[clone] + " could not be read from its indexed rows");
+    return std::move(found.front());
 }
@@ -27,25 +27,98 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <filesystem>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "clone_index.h"
 
 namespace fs = std::filesystem;
 
+/* All parsers split their input at record boundaries and parse large inputs
+* on one worker per hardware thread, merging the results in input order.
+* Streams are read and parsed a large block at a time; files given by path
+* are memory mapped. Unique sequences are returned in the order they first
+* appear, after the ancestor, each with the number of records holding it.
+*/
+
+/** Unique sequences and how many times each was read. */
+struct SequenceCounts {
+    std::vector<std::string> seqs;
+    std::vector<size_t> counts; //parallel to seqs, at least 1
+
+    //columns only dsa input has, empty otherwise, parallel to seqs
+    std::vector<size_t> reads;      //summed UMI group sizes of each sequence's records
+    std::vector<std::string> aas;   //amino acids dsa gave the first record of each sequence, empty for the template
+};
+
+/** A lineage from a table of many: its clone id and sequences, the germline first. */
+struct Lineage {
+    std::string clone_id;
+    SequenceCounts sequences;
+};
+
 /** Parse a .csv output from dsa (made with --template_dna=... and --show_codons=horizontal)
-  * and return a vector of the unique DNA sequences whose length is the same as the template.
+  * and return the unique DNA sequences whose length is the same as the template, with
+  * their counts. The template comes first.
+  * @param keep_indels keep sequences of any length, for lineages with indels
   */
-std::vector<std::string>
-parse_dsa(std::istream &ifs);
+SequenceCounts
+parse_dsa(std::istream &ifs, bool keep_indels = false);
+
+/** Parse the dsa .csv file at path, see parse_dsa(std::istream &). */
+SequenceCounts
+parse_dsa(const fs::path &path, bool keep_indels = false);
 
 /** Parse a .fasta file and return the nucleotide sequences. The first sequence in the file
-  * is assumed to be the common ancestor.
+  * is assumed to be the common ancestor. Sequences whose length differs from it are
+  * skipped unless keep_indels is set.
+  */
+SequenceCounts
+parse_fasta(std::istream &ifs, bool keep_indels = false);
+
+/** Parse the .fasta file at path, see parse_fasta(std::istream &). The file is memory
+  * mapped and scanned in place, so only the unique sequences are copied.
   */
-std::vector<std::string>
-parse_fasta(std::istream &ifs);
+SequenceCounts
+parse_fasta(const fs::path &path, bool keep_indels = false);
+
+/** Parse .fasta formatted data, see parse_fasta(std::istream &). */
+SequenceCounts
+parse_fasta(std::string_view data, bool keep_indels = false);
 
 /** Parse a plain text file with one DNA sequence per line. Return the sequences. The first
-* sequence in the file is assumed to be the common ancestor.
+* sequence in the file is assumed to be the common ancestor. Sequences whose length
+* differs from it are skipped unless keep_indels is set.
+*/
+SequenceCounts
+parse_text(std::istream &ifs, bool keep_indels = false);
+
+/** Parse the plain text file at path, see parse_text(std::istream &). */
+SequenceCounts
+parse_text(const fs::path &path, bool keep_indels = false);
+
+/** Parse an AIRR rearrangement table (tab separated, with a header line) into one
+* lineage per clone_id, in the order clones first appear, reading it in a single
+* pass. Only the sequence_alignment, germline_alignment, clone_id and optional
+* duplicate_count columns are looked at. The first germline given for a clone is
+* its root, and each row counts duplicate_count reads, 1 if empty. Rows without
+* a clone_id are skipped, as are sequences whose length differs from the germline
+* unless keep_indels is set.
+*/
+std::vector<Lineage>
+parse_airr(std::istream &ifs, bool keep_indels = false);
+
+/** Parse the AIRR table at path, see parse_airr(std::istream &). The byte ranges of
+* each lineage's rows are written to a sidecar index (see clone_index.h) so a single
+* lineage can later be read with parse_airr_clone.
+*/
+std::vector<Lineage>
+parse_airr(const fs::path &path, bool keep_indels = false);
+
+/** Parse only the rows of lineage clone of the AIRR table at path, as given by index,
+* which should come from read_clone_index(path).
 */
-std::vector<std::string>
-parse_text(std::istream &ifs);
+Lineage
+parse_airr_clone(const fs::path &path, const CloneIndex &index, size_t clone, bool keep_indels = false);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CCB_SEQUENCE_POOL_H_
+#define CCB_SEQUENCE_POOL_H_
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/** Interns sequences: each distinct string is stored once and named by a small
+* integer id, so equal sequences compare as equal ids. Ids are dense and stable,
+* and references to stored strings stay valid as more are added.
+* Id 0 is always the empty string.
+*/
+struct SequencePool {
+    /** Returned by find() for strings that have not been interned. */
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    SequencePool();
+
+    /** Get the id of s, storing it first if it is new. */
+    uint32_t intern(std::string_view s);
+
+    /** Get the id of s or NONE if it has not been interned. */
+    uint32_t find(std::string_view s) const;
+
+    /** Get the string with the given id. */
+    const std::string &operator[](uint32_t id) const { return strings_[id]; }
+
+    /** Get the number of distinct strings, including the empty one. */
+    size_t size() const { return strings_.size(); }
+
+private:
+    std::deque<std::string> strings_; //deque so views into them stay put
+    std::unordered_map<std::string_view, uint32_t> ids_; //keys view strings_
+};
+
+#endif
@@ -0,0 +1,123 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "spatial_grid.h"
+
+uint32_t
+SpatialGrid::col(float x) const {
+    const float c = std::floor((x - x0_) * inv_cell_);
+    if (!(c > 0.0f)) return 0;
+    return static_cast<uint32_t>(std::min(c, static_cast<float>(nx_ - 1)));
+}
+
+uint32_t
+SpatialGrid::row(float y) const {
+    const float r = std::floor((y - y0_) * inv_cell_);
+    if (!(r > 0.0f)) return 0;
+    return static_cast<uint32_t>(std::min(r, static_cast<float>(ny_ - 1)));
+}
+
+void
+SpatialGrid::build(std::span<const float> x, std::span<const float> y, std::span<const float> r) {
+    const size_t n = x.size();
+    if (0 == n) {
+        reshape(0.0f, 0.0f, 0.0f, 0.0f, 0, 0.0f);
+        return;
+    }
+
+    float x_min = std::numeric_limits<float>::max(), x_max = std::numeric_limits<float>::lowest();
+    float y_min = std::numeric_limits<float>::max(), y_max = std::numeric_limits<float>::lowest();
+    double r_sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        x_min = std::min(x_min, x[i] - r[i]);
+        x_max = std::max(x_max, x[i] + r[i]);
+        y_min = std::min(y_min, y[i] - r[i]);
+        y_max = std::max(y_max, y[i] + r[i]);
+        r_sum += r[i];
+    }
+    reshape(x_min, y_min, x_max, y_max, n, static_cast<float>(2.0 * r_sum / n));
+
+    std::vector<Cells> spans(n);
+    for (size_t i = 0; i < n; ++i) spans[i] = cells(x[i], y[i], r[i]);
+    fill(spans);
+}
+
+void
+SpatialGrid::reshape(float x0, float y0, float x1, float y1, size_t n, float min_cell) {
+    start_.clear();
+    items_.clear();
+    nx_ = ny_ = 0;
+    if (0 == n) return;
+
+    //about one cell per circle, but a typical circle should fit in one cell
+    const float w = std::max(x1 - x0, 1e-6f);
+    const float h = std::max(y1 - y0, 1e-6f);
+    float cell = std::sqrt(w * h / n);
+    cell = std::max(cell, min_cell);
+    cell = std::max(cell, std::max(w, h) / 4096.0f);
+
+    x0_ = x0;
+    y0_ = y0;
+    inv_cell_ = 1.0f / cell;
+    nx_ = static_cast<uint32_t>(std::ceil(w * inv_cell_)) + 1;
+    ny_ = static_cast<uint32_t>(std::ceil(h * inv_cell_)) + 1;
+}
+
+SpatialGrid::Cells
+SpatialGrid::cells(float x, float y, float r) const {
+    return Cells{.c0 = col(x - r), .c1 = col(x + r), .r0 = row(y - r), .r1 = row(y + r)};
+}
+
+void
+SpatialGrid::fill(std::span<const Cells> cells) {
+    if (0 == nx_) return;
+
+    //counting sort: count the entries in every cell, prefix sum, then fill
+    start_.assign(static_cast<size_t>(nx_) * ny_ + 1, 0);
+    for (const Cells &s : cells) {
+        for (uint32_t rr = s.r0; rr <= s.r1; ++rr) {
+            for (uint32_t c = s.c0; c <= s.c1; ++c) ++start_[static_cast<size_t>(rr) * nx_ + c + 1];
+        }
+    }
+    for (size_t c = 1; c < start_.size(); ++c) start_[c] += start_[c - 1];
+
+    std::vector<uint32_t> next(start_.begin(), start_.end() - 1);
+    items_.resize(start_.back());
+    for (size_t i = 0; i < cells.size(); ++i) {
+        const Cells &s = cells[i];
+        for (uint32_t rr = s.r0; rr <= s.r1; ++rr) {
+            for (uint32_t c = s.c0; c <= s.c1; ++c) items_[next[static_cast<size_t>(rr) * nx_ + c]++] = static_cast<uint32_t>(i);
+        }
+    }
+}
+
+std::span<const uint32_t>
+SpatialGrid::candidates(float x, float y) const {
+    if (empty()) return {};
+    const size_t cell = static_cast<size_t>(row(y)) * nx_ + col(x);
+    return std::span<const uint32_t>(items_.data() + start_[cell], start_[cell + 1] - start_[cell]);
+}
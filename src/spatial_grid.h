@@ -0,0 +1,105 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CCB_SPATIAL_GRID_H_
+#define CCB_SPATIAL_GRID_H_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/** Uniform grid over a set of circles for point and rectangle queries.
+* Every circle is listed in each cell its bounding square overlaps, so a point
+* query looks at a single cell. Cells are stored compressed: the indices of
+* the circles in cell c are items_[start_[c]..start_[c+1]) in ascending order.
+*/
+struct SpatialGrid {
+    /** The block of cells a circle overlaps, columns c0..c1 and rows r0..r1. */
+    struct Cells {
+        uint32_t c0 = 0;
+        uint32_t c1 = 0;
+        uint32_t r0 = 0;
+        uint32_t r1 = 0;
+    };
+
+    /** Rebuild the grid for circles i with center (x[i], y[i]) and radius r[i].
+    * The cell size is chosen so that there are about as many cells as circles
+    * but no smaller than the mean circle diameter.
+    */
+    void build(std::span<const float> x, std::span<const float> y, std::span<const float> r);
+
+    /** Empty the grid and lay its cells over [x0, x1] x [y0, y1], about one per
+    * circle for n circles but no smaller than min_cell. Circles outside are
+    * binned in the border cells, which queries clamp to as well.
+    */
+    void reshape(float x0, float y0, float x1, float y1, size_t n, float min_cell);
+
+    /** Get the cells of the circle at (x, y) with radius r in the current shape. */
+    Cells cells(float x, float y, float r) const;
+
+    /** Fill the reshaped grid with circle i in cells[i] for every i, see cells().
+    * Lets the caller bin circles as it moves them and index them all at once.
+    */
+    void fill(std::span<const Cells> cells);
+
+    /** Get the indices, ascending, of the circles that may contain (x, y). */
+    std::span<const uint32_t> candidates(float x, float y) const;
+
+    /** Call f(i) for every circle i that may overlap the rectangle
+    * [x0, x1] x [y0, y1]. A circle spanning several cells is visited once per cell.
+    */
+    template<typename F>
+    void visit(float x0, float y0, float x1, float y1, F f) const;
+
+    /** Check if build() has not been called or was given no circles. */
+    bool empty() const { return items_.empty(); }
+
+private:
+    /** Get the column or row of a coordinate, clamped to the grid. */
+    uint32_t col(float x) const;
+    uint32_t row(float y) const;
+
+    float x0_ = 0.0f;
+    float y0_ = 0.0f;
+    float inv_cell_ = 1.0f;
+    uint32_t nx_ = 0;
+    uint32_t ny_ = 0;
+    std::vector<uint32_t> start_;
+    std::vector<uint32_t> items_;
+};
+
+template<typename F>
+void
+SpatialGrid::visit(float x0, float y0, float x1, float y1, F f) const {
+    if (empty()) return;
+    const uint32_t c0 = col(x0), c1 = col(x1);
+    const uint32_t r0 = row(y0), r1 = row(y1);
+    for (uint32_t r = r0; r <= r1; ++r) {
+        for (uint32_t c = c0; c <= c1; ++c) {
+            const size_t cell = static_cast<size_t>(r) * nx_ + c;
+            for (uint32_t k = start_[cell]; k != start_[cell + 1]; ++k) f(items_[k]);
+        }
+    }
+}
+
+#endif
@@ -23,11 +23,14 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
+#include <cstring>
 #include <exception>
 #include <iostream>
 #include <iterator>
 #include <future>
+#include <limits>
 #include <numeric>
 #include <random>
 #include <set>
@@ -35,6 +38,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <string>
 #include <string_view>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -83,12 +87,125 @@ fitch_label_down(BNode &root);
 uint32_t
 hamming_distance(std::string_view a, std::string_view b);
 
+/** Hamming distance of equal length a and b, compared 8 chars at a time, that
+* stops counting once it exceeds limit.
+*/
+uint32_t
+bounded_hamming_distance(std::string_view a, std::string_view b, uint32_t limit);
+
+/** Number of symbols in MyersPattern: A, C, G, T, - and everything else. */
+constexpr size_t MYERS_ALPHABET = 6;
+
+/** The MyersPattern symbol of each char. */
+constexpr std::array<uint8_t, 256> MYERS_SYMBOLS = []() {
+    std::array<uint8_t, 256> symbols{};
+    symbols.fill(MYERS_ALPHABET - 1);
+    symbols['A'] = 0;
+    symbols['C'] = 1;
+    symbols['G'] = 2;
+    symbols['T'] = 3;
+    symbols['-'] = 4;
+    return symbols;
+}();
+
+/** A sequence prepared for Myers' bit-vector edit distance: for each symbol, a
+* bit mask of the positions where it occurs, 64 positions per word.
+*/
+struct MyersPattern {
+    size_t size = 0;
+    size_t words = 0;
+    std::vector<uint64_t> peq; //MYERS_ALPHABET rows of words
+
+    explicit MyersPattern(std::string_view s);
+};
+
+/** Levenshtein distance between pattern and text, computed with Myers' bit-vector
+* algorithm in O(text.size() * pattern.words) word operations.
+*/
+uint32_t
+edit_distance(const MyersPattern &pattern, std::string_view text);
+
+/** Number of BLOSUM62 symbols: the 20 amino acids and the stop codon. */
+constexpr size_t BLOSUM_ALPHABET = 21;
+
+/** The BLOSUM62 symbol of each char, BLOSUM_ALPHABET for chars that aren't residues. */
+constexpr std::array<uint8_t, 256> BLOSUM_SYMBOLS = []() {
+    std::array<uint8_t, 256> symbols{};
+    symbols.fill(BLOSUM_ALPHABET);
+    constexpr std::string_view residues = "ARNDCQEGHILKMFPSTWYV*";
+    for (size_t i = 0; i < residues.size(); ++i) symbols[static_cast<uint8_t>(residues[i])] = static_cast<uint8_t>(i);
+    return symbols;
+}();
+
+/** BLOSUM62 distance of each pair of symbols, see blosum62_distance(). */
+constexpr std::array<uint8_t, BLOSUM_ALPHABET * BLOSUM_ALPHABET> BLOSUM_COSTS = []() {
+    constexpr int8_t scores[BLOSUM_ALPHABET][BLOSUM_ALPHABET] = {
+        // A   R   N   D   C   Q   E   G   H   I   L   K   M   F   P   S   T   W   Y   V   *
+        {  4, -1, -2, -2,  0, -1, -1,  0, -2, -1, -1, -1, -1, -2, -1,  1,  0, -3, -2,  0, -4}, //A
+        { -1,  5,  0, -2, -3,  1,  0, -2,  0, -3, -2,  2, -1, -3, -2, -1, -1, -3, -2, -3, -4}, //R
+        { -2,  0,  6,  1, -3,  0,  0,  0,  1, -3, -3,  0, -2, -3, -2,  1,  0, -4, -2, -3, -4}, //N
+        { -2, -2,  1,  6, -3,  0,  2, -1, -1, -3, -4, -1, -3, -3, -1,  0, -1, -4, -3, -3, -4}, //D
+        {  0, -3, -3, -3,  9, -3, -4, -3, -3, -1, -1, -3, -1, -2, -3, -1, -1, -2, -2, -1, -4}, //C
+        { -1,  1,  0,  0, -3,  5,  2, -2,  0, -3, -2,  1,  0, -3, -1,  0, -1, -2, -1, -2, -4}, //Q
+        { -1,  0,  0,  2, -4,  2,  5, -2,  0, -3, -3,  1, -2, -3, -1,  0, -1, -3, -2, -2, -4}, //E
+        {  0, -2,  0, -1, -3, -2, -2,  6, -2, -4, -4, -2, -3, -3, -2,  0, -2, -2, -3, -3, -4}, //G
+        { -2,  0,  1, -1, -3,  0,  0, -2,  8, -3, -3, -1, -2, -1, -2, -1, -2, -2,  2, -3, -4}, //H
+        { -1, -3, -3, -3, -1, -3, -3, -4, -3,  4,  2, -3,  1,  0, -3, -2, -1, -3, -1,  3, -4}, //I
+        { -1, -2, -3, -4, -1, -2, -3, -4, -3,  2,  4, -2,  2,  0, -3, -2, -1, -2, -1,  1, -4}, //L
+        { -1,  2,  0, -1, -3,  1,  1, -2, -1, -3, -2,  5, -1, -3, -1,  0, -1, -3, -2, -2, -4}, //K
+        { -1, -1, -2, -3, -1,  0, -2, -3, -2,  1,  2, -1,  5,  0, -2, -1, -1, -1, -1,  1, -4}, //M
+        { -2, -3, -3, -3, -2, -3, -3, -3, -1,  0,  0, -3,  0,  6, -4, -2, -2,  1,  3, -1, -4}, //F
+        { -1, -2, -2, -1, -3, -1, -1, -2, -2, -3, -3, -1, -2, -4,  7, -1, -1, -4, -3, -2, -4}, //P
+        {  1, -1,  1,  0, -1,  0,  0,  0, -1, -2, -2,  0, -1, -2, -1,  4,  1, -3, -2, -2, -4}, //S
+        {  0, -1,  0, -1, -1, -1, -1, -2, -2, -1, -1, -1, -1, -2, -1,  1,  5, -2, -2,  0, -4}, //T
+        { -3, -3, -4, -4, -2, -2, -3, -2, -2, -3, -2, -3, -1,  1, -4, -3, -2, 11,  2, -3, -4}, //W
+        { -2, -2, -2, -3, -2, -1, -2, -3,  2, -1, -1, -2, -1,  3, -3, -2, -2,  2,  7, -1, -4}, //Y
+        {  0, -3, -3, -3, -1, -2, -2, -3, -3,  3,  1, -2,  1, -1, -2, -2,  0, -3, -1,  4, -4}, //V
+        { -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4,  1}  //*
+    };
+    std::array<uint8_t, BLOSUM_ALPHABET * BLOSUM_ALPHABET> costs{};
+    for (size_t x = 0; x < BLOSUM_ALPHABET; ++x) {
+        for (size_t y = 0; y < BLOSUM_ALPHABET; ++y) {
+            costs[x * BLOSUM_ALPHABET + y] = static_cast<uint8_t>(scores[x][x] + scores[y][y] - 2 * scores[x][y]);
+        }
+    }
+    return costs;
+}();
+
+/** An amino acid string prepared for BLOSUM62 distance: for each position the cost
+* of every symbol there, so scoring another string takes one lookup per residue.
+*/
+struct BlosumProfile {
+    size_t size = 0;
+    std::vector<uint8_t> costs; //BLOSUM_ALPHABET per position
+
+    /** @throw std::out_of_range if aas contains chars other than amino acids and '*' */
+    explicit BlosumProfile(std::string_view aas);
+};
+
+/** BLOSUM62 distance between profile and aas, see blosum62_distance(). */
+uint32_t
+blosum62_distance(const BlosumProfile &profile, std::string_view aas);
+
+/** Number of mismatched residues between amino acid strings a and b, compared
+* 8 at a time, plus the residues past the end of the shorter one.
+*/
+uint32_t
+amino_acid_distance(std::string_view a, std::string_view b);
+
+/** Distance between a and b by metric, a and b must be the same length for Hamming distance
+* and hold translations for amino acid metrics.
+*/
+uint32_t
+sequence_distance(std::string_view a, std::string_view b, DistanceMetric metric);
+
 /** Distance matrix entries are always uint32_t but the 2 most significant bytes
 * hold d(child, parent) and the least significant bytes hold d(parent, root).
 * Note: this means the distance matrix returned from this function is not symetric.
+* Rows are computed in parallel. For amino acid metrics sequences are translations.
 */
 Matrix<uint32_t>
-make_distance_matrix(const std::vector<std::string> &sequences);
+make_distance_matrix(const std::vector<std::string> &sequences, DistanceMetric metric);
 
 /**
 * For debugging purposes. Make a distance matrix of the appropriate size to hold
@@ -124,7 +241,8 @@ std::vector<uint32_t>
 build_mst(const std::vector<std::string_view> &input,
               const Matrix<uint32_t> &dism,
               bool shuffle_sequences,
-              bool do_infer_ancestors);
+              bool do_infer_ancestors,
+              DistanceMetric metric);
 
 struct BNode {
     uint32_t id = 0;
@@ -194,36 +312,156 @@ hamming_distance(std::string_view a, std::string_view b) {
 }
 
 uint32_t
-levenstein_distance(std::string_view a, std::string_view b) {
-    thread_local std::vector<uint32_t> upper, lower;
+bounded_hamming_distance(std::string_view a, std::string_view b, uint32_t limit) {
+    uint32_t d = 0;
+    size_t i = 0;
+    for (; i + 8 <= a.size() && d <= limit; i += 8) {
+        uint64_t x, y;
+        std::memcpy(&x, a.data() + i, 8);
+        std::memcpy(&y, b.data() + i, 8);
+        x ^= y;
+        //fold the bits of each byte into its lowest bit
+        x |= x >> 4;
+        x |= x >> 2;
+        x |= x >> 1;
+        d += std::popcount(x & 0x0101010101010101ULL);
+    }
+    for (; i < a.size() && d <= limit; ++i) d += (a[i] != b[i]);
+    return d;
+}
 
-    if (a.empty() || b.empty())
-        return std::max(uint32_t(a.size()), uint32_t(b.size()));
+MyersPattern::MyersPattern(std::string_view s)
+    : size(s.size()), words((s.size() + 63) / 64), peq(MYERS_ALPHABET * words, 0) {
+    for (size_t i = 0; i < s.size(); ++i) {
+        peq[MYERS_SYMBOLS[static_cast<uint8_t>(s[i])] * words + i / 64] |= uint64_t(1) << (i % 64);
+    }
+    //chars outside ACGT- match nothing
+    std::fill(peq.end() - words, peq.end(), 0);
+}
 
-    const size_t rows = a.size(), cols = b.size();
+uint32_t
+edit_distance(const MyersPattern &pattern, std::string_view text) {
+    thread_local std::vector<uint64_t> pv, mv;
+
+    if (0 == pattern.size) return static_cast<uint32_t>(text.size());
+
+    //column j of the DP matrix is kept as vertical deltas, +1 where pv and -1 where
+    //mv is set, and each text char advances it one word of 64 rows at a time
+    const size_t words = pattern.words;
+    pv.assign(words, ~uint64_t(0));
+    mv.assign(words, 0);
+    const uint64_t last_row = uint64_t(1) << ((pattern.size - 1) % 64);
+    uint32_t score = static_cast<uint32_t>(pattern.size);
+
+    for (char c : text) {
+        const uint64_t *peq = &pattern.peq[MYERS_SYMBOLS[static_cast<uint8_t>(c)] * words];
+        int carry = 1; //the top row of the DP matrix grows by 1 per column
+        for (size_t w = 0; w < words; ++w) {
+            const uint64_t high = (w + 1 == words) ? last_row : uint64_t(1) << 63;
+            uint64_t eq = peq[w];
+            const uint64_t p = pv[w], m = mv[w];
+            const uint64_t xv = eq | m;
+            if (carry < 0) eq |= 1;
+            const uint64_t xh = (((eq & p) + p) ^ p) | eq;
+            uint64_t ph = m | ~(xh | p);
+            uint64_t mh = p & xh;
+
+            const int out = (ph & high) ? 1 : (mh & high) ? -1 : 0;
+            ph <<= 1;
+            mh <<= 1;
+            if (carry < 0) mh |= 1;
+            else if (carry > 0) ph |= 1;
+            pv[w] = mh | ~(xv | ph);
+            mv[w] = ph & xv;
+            carry = out;
+        }
+        score += carry;
+    }
+    return score;
+}
 
-    upper.clear(); upper.resize(cols + 1, 0);
-    lower.clear(); lower.resize(cols + 1, 0);
+uint32_t
+edit_distance(std::string_view a, std::string_view b) {
+    return edit_distance(MyersPattern(a), b);
+}
 
-    for (size_t i=0; i < rows; ++i) {
-        std::swap(lower, upper);
-        for (size_t j=1; j <= cols; ++j)
-            upper[j] = lower[j - 1] + (a[i] == b[j - 1]);
+BlosumProfile::BlosumProfile(std::string_view aas)
+    : size(aas.size()), costs(aas.size() * BLOSUM_ALPHABET) {
+    for (size_t i = 0; i < aas.size(); ++i) {
+        const uint8_t x = BLOSUM_SYMBOLS[static_cast<uint8_t>(aas[i])];
+        if (BLOSUM_ALPHABET == x) throw std::out_of_range("invalid amino acid: " + std::string(1, aas[i]));
+        std::copy_n(&BLOSUM_COSTS[x * BLOSUM_ALPHABET], BLOSUM_ALPHABET, &costs[i * BLOSUM_ALPHABET]);
     }
+}
+
+uint32_t
+blosum62_distance(const BlosumProfile &profile, std::string_view aas) {
+    constexpr uint8_t STOP = BLOSUM_ALPHABET - 1;
+    auto symbol = [&](char c) {
+        const uint8_t y = BLOSUM_SYMBOLS[static_cast<uint8_t>(c)];
+        if (BLOSUM_ALPHABET == y) throw std::out_of_range("invalid amino acid in: " + std::string(aas));
+        return y;
+    };
 
-    return upper[cols];
+    const size_t n = std::min(profile.size, aas.size());
+    const uint8_t *costs = profile.costs.data();
+    uint32_t d = 0;
+    for (size_t i = 0; i < n; ++i, costs += BLOSUM_ALPHABET) d += costs[symbol(aas[i])];
+    for (size_t i = n; i < profile.size; ++i, costs += BLOSUM_ALPHABET) d += costs[STOP];
+    for (size_t i = n; i < aas.size(); ++i) d += BLOSUM_COSTS[STOP * BLOSUM_ALPHABET + symbol(aas[i])];
+    return d;
+}
+
+uint32_t
+blosum62_distance(std::string_view a, std::string_view b) {
+    return blosum62_distance(BlosumProfile(a), b);
+}
+
+uint32_t
+amino_acid_distance(std::string_view a, std::string_view b) {
+    const size_t n = std::min(a.size(), b.size());
+    return bounded_hamming_distance(a.substr(0, n), b.substr(0, n), std::numeric_limits<uint32_t>::max())
+         + static_cast<uint32_t>(std::max(a.size(), b.size()) - n);
+}
+
+uint32_t
+sequence_distance(std::string_view a, std::string_view b, DistanceMetric metric) {
+    switch (metric) {
+    case DistanceMetric::EDIT:       return edit_distance(a, b);
+    case DistanceMetric::AMINO_ACID: return amino_acid_distance(a, b);
+    case DistanceMetric::BLOSUM62:   return blosum62_distance(a, b);
+    default:                         return hamming_distance(a, b);
+    }
 }
 
 Matrix<uint32_t>
-make_distance_matrix(const std::vector<std::string> &sequences) {
+make_distance_matrix(const std::vector<std::string> &sequences, DistanceMetric metric) {
     Matrix<uint32_t> dism(sequences.size(), sequences.size(), 0);
-    for (size_t i=0; i < sequences.size(); ++i) {
-        const std::string &a = sequences[i];
-        for (size_t j=0; j < i; ++j) {
-            const std::string &b = sequences[j];
-            dism[{i, j}] = dism[{j, i}] = hamming_distance(a, b);
+
+    //row i holds the distances to all earlier sequences, rows are dealt out to
+    //the workers in turn so each gets a similar share of the triangle
+    auto fill_rows = [&](size_t first, size_t step) {
+        for (size_t i = first; i < sequences.size(); i += step) {
+            const std::string &a = sequences[i];
+            if (DistanceMetric::EDIT == metric) {
+                MyersPattern pattern(a);
+                for (size_t j = 0; j < i; ++j) dism[{i, j}] = dism[{j, i}] = edit_distance(pattern, sequences[j]);
+            } else if (DistanceMetric::BLOSUM62 == metric) {
+                BlosumProfile profile(a);
+                for (size_t j = 0; j < i; ++j) dism[{i, j}] = dism[{j, i}] = blosum62_distance(profile, sequences[j]);
+            } else if (DistanceMetric::AMINO_ACID == metric) {
+                for (size_t j = 0; j < i; ++j) dism[{i, j}] = dism[{j, i}] = amino_acid_distance(a, sequences[j]);
+            } else {
+                for (size_t j = 0; j < i; ++j) dism[{i, j}] = dism[{j, i}] = hamming_distance(a, sequences[j]);
+            }
         }
-    }
+    };
+
+    const size_t n_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    std::vector<std::future<void>> workers;
+    for (size_t t = 1; t < n_threads; ++t) workers.push_back(std::async(std::launch::async, fill_rows, t, n_threads));
+    fill_rows(0, n_threads);
+    for (std::future<void> &w : workers) w.get();
 
     //break symetry here when we include the root distances
     std::vector<uint32_t> root_distance(dism[0].begin(), dism[0].end());
@@ -439,13 +677,15 @@ infer_ancestors(const std::vector<std::string_view> &seqs, const Matrix<uint32_t
 * @param input the nucleotide sequences; the tree will be rooted on input[0]
 * @param shuffle_sequences if true, edges for addition to the tree will be considred in random order
 * @param do_infer_ancestors if true, the tree will be constructed with inferred ancestral sequences
+* @param metric how distances missing from dism are computed, amino acid metrics on translations
 * @return an vector<uint32t> 'tree' where tree[i] is the the index in input of the parent of node i
 */
 std::vector<uint32_t>
 build_mst(const std::vector<std::string_view> &input,
           const Matrix<uint32_t> &dism,
           bool shuffle_sequences,
-          bool do_infer_ancestors) {
+          bool do_infer_ancestors,
+          DistanceMetric metric) {
     constexpr uint32_t MAX_D = std::numeric_limits<uint32_t>::max();
 
     std::vector<std::string_view> sequences(input.begin(), input.end());
@@ -456,6 +696,16 @@ build_mst(const std::vector<std::string_view> &input,
         sequences.insert(sequences.end(), inferred.begin(), inferred.end());
     }
 
+    //distances missing from dism involve inferred ancestors, amino acid metrics
+    //compare translations so everything is translated once up front
+    std::vector<std::string> aas;
+    std::vector<std::string_view> compared = sequences;
+    if (is_amino_acid(metric) && !inferred.empty()) {
+        aas.reserve(sequences.size());
+        for (std::string_view s : sequences) aas.push_back(translate(s));
+        compared.assign(aas.begin(), aas.end());
+    }
+
     const size_t dim = std::max(sequences.size(), dism.rows());
 
     struct Join {
@@ -484,8 +734,8 @@ build_mst(const std::vector<std::string_view> &input,
             if (c < dism.rows() && p < dism.cols()) {
                 d = dism[{c,p}];
             } else {
-                uint32_t d1 = hamming_distance(sequences[c], sequences[p]);
-                uint32_t d2 = hamming_distance(sequences[p], sequences[0]);
+                uint32_t d1 = sequence_distance(compared[c], compared[p], metric);
+                uint32_t d2 = sequence_distance(compared[p], compared[0], metric);
                 d = (d1 << 16) | (d2 & 0xFFFF);
             }
 
@@ -566,11 +816,77 @@ calculate_parsimony_score(const std::vector<uint32_t> &tree, Matrix<uint32_t> &d
     return score;
 }
 
+Preclusters
+precluster(const std::vector<std::string> &sequences, const std::vector<size_t> &counts, uint32_t max_mismatches) {
+    constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    Preclusters clusters;
+    const size_t n = sequences.size();
+    clusters.members.assign(n, NONE);
+    if (n == 0) return clusters;
+
+    //the root is always a centre, the rest are visited from most to least abundant
+    std::vector<uint32_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin() + 1, order.end(), [&](uint32_t a, uint32_t b) { return counts[a] > counts[b]; });
+
+    //sequences within k mismatches of each other are identical in at least one
+    //of k + 1 segments, so only centres sharing a segment need to be compared
+    const size_t length = sequences[0].size(), n_segments = size_t(max_mismatches) + 1;
+    auto segment = [&](std::string_view s, size_t k) {
+        const size_t begin = k * length / n_segments, end = (k + 1) * length / n_segments;
+        return s.substr(begin, end - begin);
+    };
+    std::vector<std::unordered_map<size_t, std::vector<uint32_t>>> index(n_segments);
+    std::vector<uint32_t> checked; //the last sequence compared to each centre
+
+    for (uint32_t i : order) {
+        const std::string &seq = sequences[i];
+        uint32_t best = NONE, best_d = max_mismatches + 1;
+        for (size_t k = 0; k < n_segments && seq.size() == length; ++k) {
+            auto it = index[k].find(hash_dna(segment(seq, k)));
+            if (it == index[k].end()) continue;
+            for (uint32_t c : it->second) {
+                if (checked[c] == i) continue;
+                checked[c] = i;
+                uint32_t d = bounded_hamming_distance(seq, sequences[clusters.centres[c]], max_mismatches);
+                if (d > max_mismatches) continue;
+                //ties go to the more abundant, i.e. earlier, centre
+                if (d < best_d || (d == best_d && c < best)) {
+                    best = c;
+                    best_d = d;
+                }
+            }
+        }
+
+        if (best == NONE) {
+            best = static_cast<uint32_t>(clusters.centres.size());
+            clusters.centres.push_back(i);
+            clusters.totals.push_back(0);
+            checked.push_back(NONE);
+            if (seq.size() == length) {
+                for (size_t k = 0; k < n_segments; ++k) index[k][hash_dna(segment(seq, k))].push_back(best);
+            }
+        }
+        clusters.members[i] = best;
+        clusters.totals[best] += counts[i];
+    }
+
+    return clusters;
+}
+
 std::vector<Edge>
-build_consensus_mst(const std::vector<std::string> &input, uint32_t n_samples, bool do_infer_ancestors) {
+build_consensus_mst(const std::vector<std::string> &input, uint32_t n_samples, bool do_infer_ancestors, DistanceMetric metric) {
     std::vector<std::string_view> sequences(input.begin(), input.end());
 
-    Matrix<uint32_t> dism = make_distance_matrix(input);
+    //ancestral inference works column by column, so needs sequences of one length
+    const size_t length = input.front().size();
+    if (std::any_of(input.begin(), input.end(), [&](const std::string &s) { return s.size() != length; }))
+        do_infer_ancestors = false;
+
+    //amino acid metrics compare translations, the tree is still over the nucleotides
+    Matrix<uint32_t> dism = is_amino_acid(metric) ? make_distance_matrix(translate_all(sequences), metric)
+                                                  : make_distance_matrix(input, metric);
 
     constexpr uint32_t PCT_MAX = std::numeric_limits<uint32_t>::max();
     Matrix<uint32_t> pct(input.size(), input.size(), PCT_MAX);
@@ -580,7 +896,7 @@ build_consensus_mst(const std::vector<std::string> &input, uint32_t n_samples, b
     uint32_t remaining = n_samples;
 
     {
-        std::vector<uint32_t> max_p_tree = build_mst(sequences, dism, false, false);
+        std::vector<uint32_t> max_p_tree = build_mst(sequences, dism, false, false, metric);
         uint32_t parsimony_score = calculate_parsimony_score(max_p_tree, dism);
         std::cout << "Best possible parsimony score is " << parsimony_score << std::endl;
     }
@@ -589,7 +905,7 @@ build_consensus_mst(const std::vector<std::string> &input, uint32_t n_samples, b
     while (remaining) {
         for (size_t i = 0; i < n_threads && remaining; ++i, --remaining) {
             futures.push_back(std::async([&]()->auto {
-                return build_mst(sequences, dism, true, do_infer_ancestors);
+                return build_mst(sequences, dism, true, do_infer_ancestors, metric);
                               }));
         }
 
@@ -608,7 +924,7 @@ build_consensus_mst(const std::vector<std::string> &input, uint32_t n_samples, b
         futures.clear();
     }
 
-    std::vector<uint32_t> tree = build_mst({}, pct, false, false);
+    std::vector<uint32_t> tree = build_mst({}, pct, false, false, metric);
 
     std::vector<Edge> edges;
     edges.reserve(input.size() - 1);
@@ -624,6 +940,78 @@ build_consensus_mst(const std::vector<std::string> &input, uint32_t n_samples, b
     return edges;
 }
 
+std::vector<Edge>
+build_translation_mst(const std::vector<std::string> &input, const std::vector<size_t> &counts, uint32_t n_samples,
+                      bool do_infer_ancestors, DistanceMetric metric) {
+    std::vector<std::string_view> sequences(input.begin(), input.end());
+    std::vector<std::string> aas = translate_all(sequences);
+
+    //groups in order of first appearance, so the root's group comes first and the root leads it
+    std::unordered_map<std::string_view, uint32_t> group_of;
+    std::vector<std::vector<uint32_t>> groups;
+    for (uint32_t i = 0; i < aas.size(); ++i) {
+        auto [it, inserted] = group_of.try_emplace(aas[i], static_cast<uint32_t>(groups.size()));
+        if (inserted) groups.emplace_back();
+        groups[it->second].push_back(i);
+    }
+
+    //the most abundant member represents a group, ties go to the earliest
+    std::vector<uint32_t> reps;
+    std::vector<std::string> rep_sequences;
+    reps.reserve(groups.size());
+    rep_sequences.reserve(groups.size());
+    for (size_t g = 0; g < groups.size(); ++g) {
+        uint32_t rep = groups[g].front();
+        if (g) {
+            for (uint32_t i : groups[g]) if (counts[i] > counts[rep]) rep = i;
+        }
+        reps.push_back(rep);
+        rep_sequences.push_back(input[rep]);
+    }
+
+    std::vector<Edge> edges;
+    edges.reserve(input.size() - 1);
+    if (groups.size() > 1) {
+        for (const Edge &e : build_consensus_mst(rep_sequences, n_samples, do_infer_ancestors, metric)) {
+            edges.push_back(Edge{.parent = reps[e.parent], .child = reps[e.child], .distance = e.distance, .weight = e.weight});
+        }
+    }
+
+    //synonymous variants differ in nucleotides only, compared by edits if indels were allowed
+    for (size_t g = 0; g < groups.size(); ++g) {
+        const std::vector<uint32_t> &members = groups[g];
+        if (members.size() < 2) continue;
+
+        const bool ragged = std::any_of(members.begin(), members.end(), [&](uint32_t i) { return input[i].size() != input[reps[g]].size(); });
+        const DistanceMetric nt_metric = (ragged || DistanceMetric::EDIT == metric) ? DistanceMetric::EDIT : DistanceMetric::HAMMING;
+
+        //Prim's algorithm from the representative over the dense distances of the group
+        std::vector<uint32_t> todo;
+        for (uint32_t i : members) if (i != reps[g]) todo.push_back(i);
+        std::vector<uint32_t> best_d(todo.size(), std::numeric_limits<uint32_t>::max());
+        std::vector<uint32_t> best_p(todo.size(), reps[g]);
+        for (uint32_t added = reps[g]; !todo.empty(); ) {
+            size_t next = 0;
+            for (size_t k = 0; k < todo.size(); ++k) {
+                const uint32_t d = sequence_distance(input[todo[k]], input[added], nt_metric);
+                if (d < best_d[k]) {
+                    best_d[k] = d;
+                    best_p[k] = added;
+                }
+                if (best_d[k] < best_d[next]) next = k;
+            }
+            added = todo[next];
+            edges.push_back(Edge{.parent = best_p[next], .child = added, .distance = best_d[next], .weight = 1.0f});
+            todo.erase(todo.begin() + next);
+            best_d.erase(best_d.begin() + next);
+            best_p.erase(best_p.begin() + next);
+        }
+    }
+
+    std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.child < b.child; });
+    return edges;
+}
+
 Matrix<double>
 infer_markov_model(const std::vector<std::string> &sequences, const std::vector<Edge> &adj_list) {
     Matrix<double> m(4, 4);
@@ -639,6 +1027,7 @@ infer_markov_model(const std::vector<std::string> &sequences, const std::vector<
     for (const Edge &e : adj_list) {
         std::string_view pnts = sequences[e.parent];
         std::string_view cnts = sequences[e.child];
+        if (pnts.size() != cnts.size()) continue; //positions don't correspond across an indel
 
         for (size_t i = 0; i != pnts.size(); ++i) {
             const size_t c = lut[static_cast<uint8_t>(pnts[i])];
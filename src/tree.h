@@ -25,6 +25,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define CCB_TREE_H_
 
 #include <compare>
+#include <string_view>
 #include <string>
 #include <vector>
 
@@ -43,21 +44,89 @@ struct Edge {
     auto operator<=>(const Edge &) const = default;
 };
 
+/** How sequences are compared when building trees. */
+enum class DistanceMetric {
+    HAMMING,    /** substitutions only, sequences must be the same length */
+    EDIT,       /** substitutions, insertions and deletions (Levenshtein distance) */
+    AMINO_ACID, /** amino acid substitutions between translations, synonymous changes are free */
+    BLOSUM62    /** amino acid substitutions weighted by how rarely BLOSUM62 sees them */
+};
+
+/** Whether metric compares translations rather than nucleotides. */
+constexpr bool
+is_amino_acid(DistanceMetric metric) {
+    return DistanceMetric::AMINO_ACID == metric || DistanceMetric::BLOSUM62 == metric;
+}
+
+/** BLOSUM62 distance between amino acid strings a and b: each aligned pair x, y
+* costs s(x, x) + s(y, y) - 2 s(x, y), 0 for identical residues and up to 26 for
+* the least alike. Residues past the end of the shorter string cost as if paired
+* with a stop codon.
+* @throw std::out_of_range if a or b contain chars other than amino acids and '*'
+*/
+uint32_t
+blosum62_distance(std::string_view a, std::string_view b);
+
+/** Levenshtein distance between a and b, computed with Myers' bit-vector algorithm
+* in about a.size() / 64 word operations per char of b.
+*/
+uint32_t
+edit_distance(std::string_view a, std::string_view b);
+
+/** Sequences grouped around cluster centres by precluster(). */
+struct Preclusters {
+    std::vector<uint32_t> centres; /** Indices of the centre sequences, the root first. */
+    std::vector<uint32_t> members; /** For each input sequence, the index in centres of its centre. */
+    std::vector<size_t> totals;    /** The summed counts of each centre's members. */
+};
+
+/** Collapse sequences that are within max_mismatches of a more abundant one.
+* Sequences are visited by descending count and each joins the nearest existing
+* centre within range, or becomes a centre itself. Candidate centres come from
+* an index of k + 1 segments per centre, at least one of which a sequence within
+* k mismatches must share, so the cost is near linear in the number of sequences.
+* @param sequences non-empty list of unique sequences of equal length; sequences[0] is the root and always a centre
+* @param counts the number of reads of each sequence
+* @param max_mismatches the largest Hamming distance to absorb
+*/
+Preclusters
+precluster(const std::vector<std::string> &sequences, const std::vector<size_t> &counts, uint32_t max_mismatches);
+
 /** Build consensus of n_samples minimum spanning trees.
 * @param sequences non-empty list of unique, valid DNA sequences; tree will be rooted in sequences[0]
 * @param n_samples the number of minimum spanning trees to build consensus from
 * @param infer_ancestors if true, phylogenetic inference will be performed for each sample
-* and the inferred sequences will be used in mst construction
+* and the inferred sequences will be used in mst construction; ignored if the sequences
+* differ in length
+* @param metric the sequence distance, EDIT for lineages with indels; amino acid metrics
+* compare the translations of the sequences, the tree is still over the nucleotides
 * @return the adjacency list for the consensus tree
 */
 std::vector<Edge>
-build_consensus_mst(const std::vector<std::string> &seqeunces, uint32_t n_samples, bool infer_ancestors=true);
+build_consensus_mst(const std::vector<std::string> &seqeunces, uint32_t n_samples, bool infer_ancestors=true,
+                    DistanceMetric metric=DistanceMetric::HAMMING);
+
+/** Build a tree over unique translations first, then attach synonymous variants.
+* Sequences are grouped by translation and only one representative per group, its
+* most abundant member, goes through build_consensus_mst(), so the sampled work
+* shrinks by the square of the number of sequences per translation. Each group's
+* other members join a single minimum spanning tree of nucleotide distances rooted
+* at the representative, those edges have weight 1.
+* @param sequences non-empty list of unique, valid DNA sequences; tree will be rooted in sequences[0]
+* @param counts the number of reads of each sequence
+* @param n_samples, infer_ancestors, metric see build_consensus_mst(), they apply to the representatives
+* @return the adjacency list for the whole tree, ordered by child
+*/
+std::vector<Edge>
+build_translation_mst(const std::vector<std::string> &sequences, const std::vector<size_t> &counts, uint32_t n_samples,
+                      bool infer_ancestors=true, DistanceMetric metric=DistanceMetric::HAMMING);
 
 /** Generate a Markov model of nucleotide mutation rates from a given tree. Does not distinguish between
 * coding and silent mutations.
 * @param sequences non-empty list of unique valid un-gapped DNA sequences
 * @param adj_list an adjacency list as output by build_consensus_mst, parent and child indexes in 
 * this list should be the indices of the corresponding DNA sequences in sequences
+* Edges between sequences of different lengths are skipped.
 * @return the Markov model as a 4x4 matrix with rows/columns corresponding to A, C, G, and T in that order;
 * note that the COLUMNS sum to 1 rather than the rows, i.e. COLUMN 0 contains the probabilities that an A
 * statys an A or mutates to C, G, or T
@@ -21,59 +21,188 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
 #include <stdexcept>
-#include <unordered_map>
+#include <thread>
 
 #include "util.h"
 
+//2-bit code of each nucleotide, A=0 C=1 G=2 T=3, gaps and other characters have bit 2 set
+constexpr uint8_t NT_GAP = 4;
+constexpr uint8_t NT_BAD = 5;
+
+constexpr std::array<uint8_t, 256>
+make_nt_codes() {
+    std::array<uint8_t, 256> codes{};
+    for (uint8_t &c : codes) c = NT_BAD;
+    codes['A'] = 0;
+    codes['C'] = 1;
+    codes['G'] = 2;
+    codes['T'] = 3;
+    codes['-'] = NT_GAP;
+    return codes;
+}
+
+constexpr std::array<uint8_t, 256> NT_CODES = make_nt_codes();
+
+//amino acid of the codon with 2-bit codes a, b, c at CODONS[a << 4 | b << 2 | c]
+constexpr std::string_view CODONS =
+    "KNKNTTTTRSRSIIMI"
+    "QHQHPPPPRRRRLLLL"
+    "EDEDAAAAGGGGVVVV"
+    "*Y*YSSSS*CWCLFLF";
+
+static_assert(CODONS.size() == 64);
+
+//uppercase of each of ACGT- in either case, 0 for anything else
+constexpr std::array<char, 256>
+make_dna_folds() {
+    std::array<char, 256> folds{};
+    for (char c : std::string_view("ACGT")) {
+        folds[static_cast<uint8_t>(c)] = c;
+        folds[static_cast<uint8_t>(c - 'A' + 'a')] = c;
+    }
+    folds['-'] = '-';
+    return folds;
+}
+
+constexpr std::array<char, 256> DNA_FOLDS = make_dna_folds();
+
+size_t
+make_valid_dna(std::string_view sv, std::string &dna) {
+    const size_t start = dna.size();
+    dna.resize(start + sv.size());
+
+    //branch free: every character is written, only valid ones are kept
+    char *out = dna.data() + start;
+    size_t n = 0;
+    for (char c : sv) {
+        const char f = DNA_FOLDS[static_cast<uint8_t>(c)];
+        out[n] = f;
+        n += (f != 0);
+    }
+
+    dna.resize(start + n);
+    return sv.size() - n;
+}
+
 std::pair<std::string, size_t>
 make_valid_dna(std::string_view sv) {
-    static const std::string_view ACGT = "ACGT-";
     std::string dna;
-    size_t filtered = 0;
+    size_t filtered = make_valid_dna(sv, dna);
+    return std::make_pair(std::move(dna), filtered);
+}
+
+size_t
+make_valid_dna(std::string_view sv, PackedDna &packed) {
+    size_t n = packed.size;
+    packed.bytes.resize((n + sv.size() + 3) / 4, 0);
+
+    //unused high bits of the last byte are always 0 so codes can be or'ed in
+    uint8_t *out = packed.bytes.data();
     for (char c : sv) {
-        c = std::toupper(c);
-        if (ACGT.find(c) != std::string::npos) {
-            dna.push_back(c);
-        } else {
-            ++filtered;
-        } 
+        const uint8_t code = NT_CODES[static_cast<uint8_t>(DNA_FOLDS[static_cast<uint8_t>(c)])];
+        const uint8_t valid = code < 4;
+        out[n >> 2] |= static_cast<uint8_t>((code & 3) << (2 * (n & 3))) & static_cast<uint8_t>(-valid);
+        n += valid;
     }
-    return std::make_pair(dna, filtered);
+
+    const size_t filtered = sv.size() - (n - packed.size);
+    packed.size = n;
+    packed.bytes.resize((n + 3) / 4);
+    return filtered;
+}
+
+size_t
+hash_dna(std::string_view nts) {
+    constexpr uint64_t K = 0x9E3779B97F4A7C15ULL;
+    constexpr uint64_t LOW_BITS = 0x0303030303030303ULL;
+    auto mix = [](uint64_t x) {
+        x *= K;
+        x ^= x >> 29;
+        x *= 0xBF58476D1CE4E5B9ULL;
+        return x ^ (x >> 32);
+    };
+
+    //bits 1-2 of each char give A0 C1 T2 G3. Each 32 chars pack into a word
+    //whose byte b holds the codes of chars b, b+8, b+16 and b+24.
+    auto pack = [](const char *p) {
+        uint64_t w[4];
+        std::memcpy(w, p, sizeof(w));
+        return ((w[0] >> 1) & LOW_BITS)
+             | ((w[1] << 1) & LOW_BITS << 2)
+             | ((w[2] << 3) & LOW_BITS << 4)
+             | ((w[3] << 5) & LOW_BITS << 6);
+    };
+
+    const size_t n = nts.size();
+    uint64_t h = n * K;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) h = mix(h ^ pack(nts.data() + i));
+    if (i < n) {
+        char tail[32] = {};
+        std::memcpy(tail, nts.data() + i, n - i);
+        h = mix(h ^ pack(tail));
+    }
+    return static_cast<size_t>(h);
 }
 
 std::string
 translate(std::string_view nts) {
-    static const std::unordered_map<std::string, char> translation = {
-        {"AAA", 'K'}, {"AAC", 'N'}, {"AAG", 'K'}, {"AAT", 'N'},
-        {"ACA", 'T'}, {"ACC", 'T'}, {"ACG", 'T'}, {"ACT", 'T'},
-        {"AGA", 'R'}, {"AGC", 'S'}, {"AGG", 'R'}, {"AGT", 'S'},
-        {"ATA", 'I'}, {"ATC", 'I'}, {"ATG", 'M'}, {"ATT", 'I'},
-        {"CAA", 'Q'}, {"CAC", 'H'}, {"CAG", 'Q'}, {"CAT", 'H'},
-        {"CCA", 'P'}, {"CCC", 'P'}, {"CCG", 'P'}, {"CCT", 'P'},
-        {"CGA", 'R'}, {"CGC", 'R'}, {"CGG", 'R'}, {"CGT", 'R'},
-        {"CTA", 'L'}, {"CTC", 'L'}, {"CTG", 'L'}, {"CTT", 'L'},
-        {"GAA", 'E'}, {"GAC", 'D'}, {"GAG", 'E'}, {"GAT", 'D'},
-        {"GCA", 'A'}, {"GCC", 'A'}, {"GCG", 'A'}, {"GCT", 'A'},
-        {"GGA", 'G'}, {"GGC", 'G'}, {"GGG", 'G'}, {"GGT", 'G'},
-        {"GTA", 'V'}, {"GTC", 'V'}, {"GTG", 'V'}, {"GTT", 'V'},
-        {"TAA", '*'}, {"TAC", 'Y'}, {"TAG", '*'}, {"TAT", 'Y'},
-        {"TCA", 'S'}, {"TCC", 'S'}, {"TCG", 'S'}, {"TCT", 'S'},
-        {"TGA", '*'}, {"TGC", 'C'}, {"TGG", 'W'}, {"TGT", 'C'},
-        {"TTA", 'L'}, {"TTC", 'F'}, {"TTG", 'L'}, {"TTT", 'F'}
-    };
     std::string aas;
-    std::string cdn;
 
-    for (size_t i=0; i != nts.size(); ++i) {
-        if ('-' != nts[i]) cdn.push_back(nts[i]);
-        if (3 == cdn.size()) {
-            aas.push_back(translation.at(cdn));
-            cdn.clear();
+    //without gaps every codon is three consecutive characters
+    if (nts.find('-') == std::string_view::npos) {
+        aas.resize(nts.size() / 3);
+        const uint8_t *nt = reinterpret_cast<const uint8_t *>(nts.data());
+        for (size_t k = 0; k != aas.size(); ++k, nt += 3) {
+            const uint8_t a = NT_CODES[nt[0]], b = NT_CODES[nt[1]], c = NT_CODES[nt[2]];
+            if ((a | b | c) & NT_GAP) throw std::out_of_range("invalid codon: " + std::string(nts.substr(3 * k, 3)));
+            aas[k] = CODONS[a << 4 | b << 2 | c];
         }
+        return aas;
     }
-    
+
+    //gaps are skipped, codons are read across them
+    aas.reserve(nts.size() / 3);
+    uint8_t cdn = 0, len = 0, invalid = 0;
+    for (char ch : nts) {
+        const uint8_t code = NT_CODES[static_cast<uint8_t>(ch)];
+        if (NT_GAP == code) continue;
+        invalid |= code & NT_GAP;
+        cdn = ((cdn << 2) | (code & 3)) & 63;
+        if (3 == ++len) {
+            if (invalid) throw std::out_of_range("invalid codon in: " + std::string(nts));
+            aas.push_back(CODONS[cdn]);
+            len = 0;
+        }
+    }
+
+    return aas;
+}
+
+std::vector<std::string>
+translate_all(std::span<const std::string_view> nts, size_t workers) {
+    if (!workers) workers = std::max(1U, std::thread::hardware_concurrency());
+    workers = std::max<size_t>(1, std::min(workers, nts.size()));
+    const size_t chunk = (nts.size() + workers - 1) / workers;
+
+    std::vector<std::string> aas(nts.size());
+    std::vector<std::future<void>> futures;
+    for (size_t w = 0; w != workers; ++w) {
+        const size_t lo = std::min(nts.size(), w * chunk);
+        const size_t hi = std::min(nts.size(), (w + 1) * chunk);
+        futures.push_back(std::async(std::launch::async, [&, lo, hi]() {
+            for (size_t i = lo; i != hi; ++i) aas[i] = translate(nts[i]);
+        }));
+    }
+    for (std::future<void> &f : futures) f.get(); //rethrows
+
     return aas;
 }
 
@@ -24,6 +24,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef CCB_UTIL_H_
 #define CCB_UTIL_H_
 
+#include <cstdint>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -44,18 +46,58 @@ struct RGB {
 extern const
 std::vector<std::string> PALETTE;
 
+/** Nucleotides packed four to a byte as 2-bit codes A=0 C=1 G=2 T=3, the
+* first in the low bits. Unused bits of the last byte are 0.
+*/
+struct PackedDna {
+    std::vector<uint8_t> bytes;
+    size_t size = 0;
+
+    /** Get the 2-bit code of nucleotide i. */
+    uint8_t operator[](size_t i) const { return (bytes[i >> 2] >> (2 * (i & 3))) & 3; }
+};
+
 /** Casefold sv and return a string of ACGT only chars, and the number of chars filtered from sv. */
 std::pair<std::string, size_t>
 make_valid_dna(std::string_view sv);
 
-/** Translate string of nucleotides to amino acids
-* @param uppercase string of only ACGT
+/** Casefold sv and append its ACGT- chars to dna, growing it once.
+* @return the number of chars filtered from sv
+*/
+size_t
+make_valid_dna(std::string_view sv, std::string &dna);
+
+/** Casefold sv and append its ACGT chars to packed in 2-bit form. Gaps can't
+* be represented and are filtered along with invalid chars.
+* @return the number of chars filtered from sv
+*/
+size_t
+make_valid_dna(std::string_view sv, PackedDna &packed);
+
+/** Hash a string of ACGT- chars through their 2-bit codes, packing 32
+* nucleotides into each 64-bit word that is mixed into the hash. Gaps share
+* a code with T, which only costs a collision between gapped sequences.
+*/
+size_t
+hash_dna(std::string_view nts);
+
+/** Translate string of nucleotides to amino acids. Gaps ('-') are skipped
+* and a trailing partial codon is ignored. Codons are looked up in a 64 entry
+* table indexed by their 2-bit packed nucleotides.
+* @param uppercase string of only ACGT-
 * @return string containing the translation
 * @throw std::out_of_range if invalid characters are included in nts
 */
 std::string
 translate(std::string_view);
 
+/** Translate every sequence in nts, see translate(), split over up to
+* workers threads (0 for one per hardware thread).
+* @throw std::out_of_range if any sequence contains invalid characters
+*/
+std::vector<std::string>
+translate_all(std::span<const std::string_view> nts, size_t workers = 0);
+
 /** Return mean and standard devation of v. */
 std::pair<float, float>
 exp_dist_mean_and_sdev(const std::vector<size_t> &v);